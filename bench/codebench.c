@@ -0,0 +1,375 @@
+/* generated code benchmark, compiles every program with & without optimizations, runs it on the embedded vm and
+    checks the output against <program>.out and the instruction count & rom size against bench/baseline.txt */
+
+#include "uparse.h"
+#include "uopt.h"
+#include "usema.h"
+#include "uasm.h"
+#include "urom.h"
+#include "uvm.h"
+
+#define BASELINE_PATH "bench/baseline.txt"
+#define DEFAULT_THRESHOLD 2.0 /* percent */
+#define INSTRUCTION_LIMIT 100000000
+#define MAX_NAME 64
+#define MAX_RESULTS 256
+
+typedef struct {
+    const char *name;
+    int optimize;
+} UConfig;
+
+static const UConfig configs[] = {
+    {"O0", 0},
+    {"O", 1}
+};
+
+typedef struct {
+    char name[MAX_NAME];
+    char config[8];
+    unsigned long instructions;
+    int romSize;
+} UResult;
+
+static UResult baseline[MAX_RESULTS];
+static int bCount = 0;
+static UResult results[MAX_RESULTS];
+static int rCount = 0;
+
+/* ==================================[[ helpers ]]================================== */
+
+/* reads the whole stream into a null terminated buffer */
+char *readText(FILE *file) {
+    size_t size, bytesRead;
+    char *buffer;
+
+    fseek(file, 0L, SEEK_END);
+    size = ftell(file);
+    rewind(file);
+
+    buffer = (char*)UM_realloc(NULL, size + 1);
+    bytesRead = fread(buffer, 1, size, file);
+    buffer[bytesRead] = '\0';
+    return buffer;
+}
+
+/* returns NULL if the file can't be opened */
+char *readPath(const char *path) {
+    FILE *file = fopen(path, "rb");
+    char *buffer;
+
+    if (file == NULL)
+        return NULL;
+
+    buffer = readText(file);
+    fclose(file);
+    return buffer;
+}
+
+/* strips trailing whitespace, the output always ends with the space print-decimal writes */
+void trimEnd(char *str) {
+    int len = strlen(str);
+
+    while (len > 0 && (str[len - 1] == ' ' || str[len - 1] == '\n' || str[len - 1] == '\r'))
+        str[--len] = '\0';
+}
+
+/* "bench/programs/arith.uxc" -> "arith" */
+void programName(const char *path, char *out) {
+    const char *start = strrchr(path, '/');
+    const char *end = strrchr(path, '.');
+    int len;
+
+    start = start ? start + 1 : path;
+    if (end == NULL || end < start)
+        end = start + strlen(start);
+
+    len = end - start;
+    if (len >= MAX_NAME)
+        len = MAX_NAME - 1;
+    memcpy(out, start, len);
+    out[len] = '\0';
+}
+
+/* "bench/programs/arith.uxc" -> "bench/programs/arith.out" */
+void outputPath(const char *path, char *out) {
+    const char *end = strrchr(path, '.');
+    int len = end ? end - path : (int)strlen(path);
+
+    memcpy(out, path, len);
+    strcpy(out + len, ".out");
+}
+
+UResult *findBaseline(const char *name, const char *config) {
+    int i;
+
+    for (i = 0; i < bCount; i++) {
+        if (strcmp(baseline[i].name, name) == 0 && strcmp(baseline[i].config, config) == 0)
+            return &baseline[i];
+    }
+
+    return NULL;
+}
+
+/* baseline lines are "<program> <config> <instructions> <rom bytes>", lines starting with '#' are comments */
+void loadBaseline(void) {
+    FILE *file = fopen(BASELINE_PATH, "r");
+    char line[256];
+    UResult *res;
+
+    if (file == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), file) && bCount < MAX_RESULTS) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        res = &baseline[bCount];
+        if (sscanf(line, "%63s %7s %lu %d", res->name, res->config, &res->instructions, &res->romSize) == 4)
+            bCount++;
+    }
+
+    fclose(file);
+}
+
+void writeBaseline(void) {
+    FILE *file = fopen(BASELINE_PATH, "w");
+    int i;
+
+    if (file == NULL) {
+        fprintf(stderr, "Could not write \"%s\".\n", BASELINE_PATH);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(file, "# program config instructions rom-bytes, regenerate with `make bench-update`\n");
+    for (i = 0; i < rCount; i++)
+        fprintf(file, "%s %s %lu %d\n", results[i].name, results[i].config, results[i].instructions, results[i].romSize);
+
+    fclose(file);
+}
+
+double percentChange(unsigned long now, unsigned long base) {
+    return base ? 100.0 * ((double)now - (double)base) / (double)base : 0.0;
+}
+
+/* ==================================[[ pipeline ]]================================== */
+
+/* compiles & assembles the source, returns NULL if the assembler failed */
+URom *compileRom(const char *src, int optimize, char *err) {
+    UOptions opts;
+    UASTRootNode *tree;
+    UOutBuf tal;
+    URom *rom;
+
+    memset(&opts, 0, sizeof(opts));
+    if (optimize)
+        opts.foldConstants = opts.peephole = opts.strengthReduce = opts.deadCode = opts.zeroPage = opts.staticFrame = 1;
+
+    tree = UP_parseSource(src, NULL, NULL);
+    US_checkTypes(tree, NULL);
+    if (opts.foldConstants)
+        UO_foldConstants(tree);
+    if (opts.deadCode)
+        UO_eliminateDeadCode(tree);
+    US_resolve(tree, &opts, NULL);
+    UA_initBuffer(&tal, -1);
+    UA_genTal(tree, &tal, &opts, NULL);
+    UP_freeTree(tree);
+
+    rom = (URom*)UM_realloc(NULL, sizeof(URom));
+    UR_initRom(rom);
+    if (!UR_assemble(rom, tal.buf)) {
+        strcpy(err, rom->err);
+        UR_freeRom(rom);
+        UM_free(rom);
+        rom = NULL;
+    }
+
+    UA_freeBuffer(&tal);
+    return rom;
+}
+
+/* runs the rom, returns its console output or NULL if it faulted */
+char *runRom(URom *rom, unsigned long *instructions, char *err) {
+    UVM *vm = (UVM*)UM_realloc(NULL, sizeof(UVM));
+    FILE *console = tmpfile();
+    char *output = NULL;
+
+    UV_initVM(vm, rom, console);
+    vm->limit = INSTRUCTION_LIMIT;
+    if (UV_run(vm, ROM_START)) {
+        output = readText(console);
+        *instructions = vm->instructions;
+    } else {
+        strcpy(err, vm->err);
+    }
+
+    fclose(console);
+    UM_free(vm);
+    return output;
+}
+
+/* ==================================[[ benchmark ]]================================== */
+
+/* returns 1 if the program passed in every config */
+int benchProgram(const char *path, double threshold, int update) {
+    char name[MAX_NAME], outPath[512], err[128];
+    char *src, *expected, *output;
+    unsigned long instructions = 0;
+    int i, passed = 1;
+
+    programName(path, name);
+    outputPath(path, outPath);
+    if (strlen(path) >= sizeof(outPath) - 4 || (src = readPath(path)) == NULL) {
+        printf("%-16s could not read \"%s\"\n", name, path);
+        return 0;
+    }
+
+    expected = readPath(outPath);
+    if (expected)
+        trimEnd(expected);
+
+    for (i = 0; i < sizeof(configs)/sizeof(UConfig); i++) {
+        URom *rom = compileRom(src, configs[i].optimize, err);
+        UResult *base, *res;
+        const char *status = "ok";
+
+        printf("%-16s %-3s ", name, configs[i].name);
+        if (rom == NULL) {
+            printf("assembler error: %s\n", err);
+            passed = 0;
+            continue;
+        }
+
+        if ((output = runRom(rom, &instructions, err)) == NULL) {
+            printf("runtime error: %s\n", err);
+            UR_freeRom(rom);
+            UM_free(rom);
+            passed = 0;
+            continue;
+        }
+        trimEnd(output);
+
+        /* the first run records the expected output */
+        if (expected == NULL && update) {
+            FILE *file = fopen(outPath, "w");
+            if (file) {
+                fprintf(file, "%s\n", output);
+                fclose(file);
+            }
+            expected = output;
+            output = NULL;
+        }
+
+        if (rCount == MAX_RESULTS) {
+            printf("too many results!\n");
+            exit(EXIT_FAILURE);
+        }
+
+        res = &results[rCount++];
+        strcpy(res->name, name);
+        strcpy(res->config, configs[i].name);
+        res->instructions = instructions;
+        res->romSize = UR_romSize(rom);
+
+        base = findBaseline(name, configs[i].name);
+        if (expected == NULL) {
+            status = "NO EXPECTED OUTPUT";
+            passed = 0;
+        } else if (output != NULL && strcmp(output, expected) != 0) {
+            status = "WRONG OUTPUT";
+            passed = 0;
+        } else if (base == NULL) {
+            status = update ? "new" : "NO BASELINE";
+            passed &= update;
+        } else if (!update && (percentChange(res->instructions, base->instructions) > threshold ||
+                percentChange(res->romSize, base->romSize) > threshold)) {
+            status = "REGRESSED";
+            passed = 0;
+        }
+
+        if (base) {
+            printf("%10lu (%+6.1f%%) %6d (%+6.1f%%)  %s\n", res->instructions, percentChange(res->instructions, base->instructions),
+                res->romSize, percentChange(res->romSize, base->romSize), status);
+        } else {
+            printf("%10lu %10s %6d %10s  %s\n", res->instructions, "", res->romSize, "", status);
+        }
+
+        UM_free(output);
+        UR_freeRom(rom);
+        UM_free(rom);
+    }
+
+    UM_free(expected);
+    UM_free(src);
+    return passed;
+}
+
+/* the rom size of every program against its baseline, summed per config. the runtime routines are part of every
+    rom, so changes to them show up here */
+void printRomTotals(void) {
+    int i, c;
+
+    for (c = 0; c < sizeof(configs)/sizeof(UConfig); c++) {
+        unsigned long now = 0, base = 0;
+
+        for (i = 0; i < rCount; i++) {
+            UResult *b = findBaseline(results[i].name, results[i].config);
+
+            if (b && strcmp(results[i].config, configs[c].name) == 0) {
+                now += results[i].romSize;
+                base += b->romSize;
+            }
+        }
+
+        if (base)
+            printf("%-16s %-3s %21s %6lu (%+6.1f%%)  %+ld bytes\n", "total", configs[c].name, "", now,
+                percentChange(now, base), (long)now - (long)base);
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    double threshold = DEFAULT_THRESHOLD;
+    int update = 0, failed = 0, programs = 0, i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            update = 1;
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            printf("Usage: %s [--update] [--threshold PERCENT] PROGRAMS...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    loadBaseline();
+    printf("%-16s %-3s %21s %17s\n", "program", "cfg", "instructions", "rom bytes");
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threshold") == 0) {
+            i++;
+            continue;
+        }
+        if (argv[i][0] == '-')
+            continue;
+
+        programs++;
+        if (!benchProgram(argv[i], threshold, update))
+            failed++;
+    }
+
+    printRomTotals();
+
+    if (failed) {
+        printf("%d of %d programs failed (threshold %.1f%%)\n", failed, programs, threshold);
+        return EXIT_FAILURE;
+    } else if (update) {
+        writeBaseline();
+        printf("wrote %d results to %s\n", rCount, BASELINE_PATH);
+    } else {
+        printf("all %d programs passed (threshold %.1f%%)\n", programs, threshold);
+    }
+
+    return 0;
+}
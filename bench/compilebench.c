@@ -0,0 +1,291 @@
+/* compiler throughput benchmark, generates programs of growing size (N statements, nested M scopes deep, K locals per
+    scope), times each stage of the pipeline separately and checks that the time per byte stays flat as the input grows */
+
+#include "umem.h"
+#include "ulex.h"
+#include "uparse.h"
+#include "uopt.h"
+#include "usema.h"
+#include "uasm.h"
+
+#include <time.h>
+#include <sys/resource.h>
+
+#define DEFAULT_STATEMENTS 20000
+#define DEFAULT_DEPTH 8
+#define DEFAULT_LOCALS 4
+#define SIZE_STEPS 4 /* each step doubles the statement count */
+#define MAX_SLOWDOWN 2.0 /* largest allowed growth of the time per byte between the smallest & largest input */
+#define MIN_SECONDS 0.02 /* stages faster than this are too noisy to compare */
+
+typedef enum {
+    STAGE_LEX,
+    STAGE_PARSE,
+    STAGE_RESOLVE,
+    STAGE_CODEGEN,
+    STAGE_FREE,
+    STAGE_MAX
+} UStage;
+
+static const char *stageNames[] = {
+    "lex",
+    "parse",
+    "resolve",
+    "codegen",
+    "free"
+};
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    uint32_t seed;
+} USource;
+
+/* ==================================[[ generator ]]================================== */
+
+void appendf(USource *src, const char *fmt, ...) {
+    char tmp[256];
+    size_t len;
+    va_list args;
+
+    va_start(args, fmt);
+    len = vsprintf(tmp, fmt, args);
+    va_end(args);
+
+    while (src->len + len + 1 > src->cap) {
+        src->cap *= GROW_FACTOR;
+        src->buf = (char*)UM_realloc(src->buf, src->cap);
+    }
+
+    memcpy(src->buf + src->len, tmp, len + 1);
+    src->len += len;
+}
+
+/* deterministic, so every run benchmarks the same program */
+int nextRand(USource *src, int range) {
+    src->seed = src->seed * 1103515245 + 12345;
+    return (src->seed >> 16) % range;
+}
+
+void indent(USource *src, int depth) {
+    int i;
+
+    for (i = 0; i < depth; i++)
+        appendf(src, "    ");
+}
+
+/* locals are named after their scope, so every visible local is "v<depth>_<index>" for depth <= the current depth */
+void genVar(USource *src, int depth, int locals, char *out) {
+    sprintf(out, "v%d_%d", nextRand(src, depth + 1), nextRand(src, locals));
+}
+
+void genStatement(USource *src, int depth, int locals) {
+    char a[32], b[32], c[32];
+
+    genVar(src, depth, locals, a);
+    genVar(src, depth, locals, b);
+    genVar(src, depth, locals, c);
+
+    indent(src, depth + 1);
+    switch (nextRand(src, 6)) {
+        case 0: appendf(src, "%s = %s + %s * %d;\n", a, b, c, nextRand(src, 100)); break;
+        case 1: appendf(src, "%s = %s - %s / %d;\n", a, b, c, nextRand(src, 100) + 1); break;
+        case 2: appendf(src, "if (%s < %s) %s = %s + 1; else %s = %s;\n", a, b, a, a, c, b); break;
+        case 3: appendf(src, "while (%s > %d) %s = %s - 1;\n", a, nextRand(src, 1000), a, a); break;
+        case 4: appendf(src, "for (%s = 0; %s < %s; %s = %s + 1) %s = %s + %s;\n", a, a, b, a, a, c, c, a); break;
+        default: appendf(src, "prntint %s + %s;\n", a, b); break;
+    }
+}
+
+/* writes a scope holding `locals` declarations, then statements & nested scopes until `*left` statements were written */
+void genScope(USource *src, int depth, int maxDepth, int locals, int *left) {
+    int i, perScope = 8 + nextRand(src, 8);
+
+    indent(src, depth);
+    appendf(src, "{\n");
+
+    for (i = 0; i < locals; i++) {
+        indent(src, depth + 1);
+        appendf(src, "int v%d_%d = %d;\n", depth, i, nextRand(src, 0x10000));
+    }
+
+    for (i = 0; i < perScope && *left > 0; i++, (*left)--)
+        genStatement(src, depth, locals);
+
+    if (depth + 1 < maxDepth && *left > 0)
+        genScope(src, depth + 1, maxDepth, locals, left);
+
+    indent(src, depth);
+    appendf(src, "}\n");
+}
+
+char *generateSource(int statements, int depth, int locals, size_t *len) {
+    USource src;
+    int left = statements;
+
+    src.cap = 0x10000;
+    src.len = 0;
+    src.seed = 1;
+    src.buf = (char*)UM_realloc(NULL, src.cap);
+    src.buf[0] = '\0';
+
+    /* chains of nested scopes until every statement is written */
+    while (left > 0)
+        genScope(&src, 0, depth, locals, &left);
+
+    *len = src.len;
+    return src.buf;
+}
+
+/* ==================================[[ harness ]]================================== */
+
+double seconds(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* peak resident set size of the whole process in KiB */
+long peakRSS(void) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void benchSource(const char *src, UOptions *opts, double *times) {
+    ULexState lex;
+    UToken tkn;
+    UASTRootNode *tree;
+    UOutBuf out;
+    clock_t start;
+
+    start = clock();
+    UL_initLexState(&lex, src);
+    do {
+        tkn = UL_scanNext(&lex);
+    } while (tkn.type != TOKEN_EOF && tkn.type != TOKEN_ERR);
+    times[STAGE_LEX] = seconds(start);
+
+    start = clock();
+    tree = UP_parseSource(src, NULL, NULL);
+    US_checkTypes(tree, NULL);
+    if (opts->foldConstants)
+        UO_foldConstants(tree);
+    if (opts->deadCode)
+        UO_eliminateDeadCode(tree);
+    times[STAGE_PARSE] = seconds(start);
+
+    start = clock();
+    US_resolve(tree, opts, NULL);
+    times[STAGE_RESOLVE] = seconds(start);
+
+    /* codegen is timed into memory, so disk speed doesn't count */
+    UA_initBuffer(&out, -1);
+    start = clock();
+    UA_genTal(tree, &out, opts, NULL);
+    times[STAGE_CODEGEN] = seconds(start);
+    UA_freeBuffer(&out);
+
+    start = clock();
+    UP_freeTree(tree);
+    times[STAGE_FREE] = seconds(start);
+}
+
+void printUsage(const char *name) {
+    printf("Usage: %s [-n STATEMENTS] [-d DEPTH] [-k LOCALS] [-O] [--emit FILE]\n"
+        "\t-n\tstatements in the smallest program, each step doubles it (default %d)\n"
+        "\t-d\tscope nesting depth (default %d)\n"
+        "\t-k\tlocals declared per scope (default %d)\n"
+        "\t-O\tenable all optimizations\n"
+        "\t--emit\twrite the smallest program to FILE and exit\n",
+        name, DEFAULT_STATEMENTS, DEFAULT_DEPTH, DEFAULT_LOCALS);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, const char *argv[]) {
+    int statements = DEFAULT_STATEMENTS, depth = DEFAULT_DEPTH, locals = DEFAULT_LOCALS;
+    double times[SIZE_STEPS][STAGE_MAX], perByte[SIZE_STEPS][STAGE_MAX];
+    const char *emit = NULL;
+    UOptions opts;
+    int step, stage, i, failed = 0;
+
+    memset(&opts, 0, sizeof(opts));
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            statements = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+            locals = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-O") == 0)
+            opts.foldConstants = opts.peephole = opts.strengthReduce = opts.deadCode = opts.zeroPage = opts.staticFrame = 1;
+        else if (strcmp(argv[i], "--emit") == 0 && i + 1 < argc)
+            emit = argv[++i];
+        else
+            printUsage(argv[0]);
+    }
+
+    if (statements < 1 || depth < 1 || locals < 1)
+        printUsage(argv[0]);
+
+    if (emit) {
+        size_t len;
+        char *src = generateSource(statements, depth, locals, &len);
+        FILE *out = fopen(emit, "w");
+
+        if (out == NULL || fwrite(src, 1, len, out) != len) {
+            fprintf(stderr, "Could not write \"%s\".\n", emit);
+            return EXIT_FAILURE;
+        }
+
+        fclose(out);
+        UM_free(src);
+        return 0;
+    }
+
+    printf("%d locals per scope, %d scopes deep\n", locals, depth);
+    printf("%10s %10s", "statements", "KiB");
+    for (stage = 0; stage < STAGE_MAX; stage++)
+        printf(" %14s", stageNames[stage]);
+    printf(" %10s\n", "peak RSS");
+
+    for (step = 0; step < SIZE_STEPS; step++) {
+        int count = statements << step;
+        size_t len;
+        char *src = generateSource(count, depth, locals, &len);
+
+        benchSource(src, &opts, times[step]);
+
+        printf("%10d %10lu", count, (unsigned long)(len / 1024));
+        for (stage = 0; stage < STAGE_MAX; stage++) {
+            perByte[step][stage] = times[step][stage] / len;
+            printf(" %7.1fms %4.0f", times[step][stage] * 1000, times[step][stage] > 0 ? len / times[step][stage] / 1e6 : 0.0);
+        }
+        printf(" %7ldKiB\n", peakRSS());
+
+        UM_free(src);
+    }
+    printf("(each stage is its time & MB/s of source)\n");
+
+    /* compile time should grow linearly, so the time per byte of the largest input shouldn't be much worse than the
+        smallest. stages too fast to time reliably are skipped */
+    for (stage = 0; stage < STAGE_MAX; stage++) {
+        double ratio;
+
+        if (times[0][stage] < MIN_SECONDS || perByte[0][stage] <= 0)
+            continue;
+
+        ratio = perByte[SIZE_STEPS - 1][stage] / perByte[0][stage];
+        if (ratio > MAX_SLOWDOWN) {
+            printf("%s doesn't scale linearly! time per byte grew %.2fx over a %dx larger input\n",
+                stageNames[stage], ratio, 1 << (SIZE_STEPS - 1));
+            failed = 1;
+        }
+    }
+
+    if (failed)
+        return EXIT_FAILURE;
+
+    printf("every stage scales linearly (within %.1fx)\n", MAX_SLOWDOWN);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/* lexer microbenchmark, scans an identifier/keyword heavy source until enough time has passed and reports tokens per second */
+
+#include "umem.h"
+#include "ulex.h"
+
+#include <time.h>
+
+#define SOURCE_LINES 20000
+#define MIN_SECONDS 1.0
+
+static const char *lines[] = {
+    "int counter = counter + 1;\n",
+    "for (index = 0; index < limit; index = index + 1) prntint index;\n",
+    "while (value > 0) { value = value - 1; }\n",
+    "if (flag) prntint total; else prntint other;\n",
+    "bool done = counter == limit;\n",
+    "char c = 'a';\n",
+    "{ int tmp = a * b / c; void_like = tmp; }\n",
+};
+
+char *makeSource(void) {
+    size_t size = 0, offset = 0;
+    char *src;
+    int i;
+
+    for (i = 0; i < SOURCE_LINES; i++)
+        size += strlen(lines[i % (sizeof(lines)/sizeof(lines[0]))]);
+
+    src = (char*)UM_realloc(NULL, size + 1);
+    for (i = 0; i < SOURCE_LINES; i++) {
+        const char *line = lines[i % (sizeof(lines)/sizeof(lines[0]))];
+        memcpy(src + offset, line, strlen(line));
+        offset += strlen(line);
+    }
+
+    src[offset] = '\0';
+    return src;
+}
+
+int main(void) {
+    char *src = makeSource();
+    unsigned long tokens = 0, idents = 0, keywords = 0;
+    double elapsed;
+    clock_t start;
+    ULexState state;
+    UToken tkn;
+
+    start = clock();
+    do {
+        UL_initLexState(&state, src);
+        do {
+            tkn = UL_scanNext(&state);
+            tokens++;
+            if (tkn.type == TOKEN_IDENT)
+                idents++;
+            else if (tkn.type <= TOKEN_FOR)
+                keywords++;
+        } while (tkn.type != TOKEN_EOF && tkn.type != TOKEN_ERR);
+
+        elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    } while (elapsed < MIN_SECONDS);
+
+    printf("%lu tokens (%lu identifiers, %lu keywords) in %.2fs\n", tokens, idents, keywords, elapsed);
+    printf("%.2f million tokens/s\n", tokens / elapsed / 1e6);
+
+    UM_free(src);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/* peephole regression check, runs UI_peephole() over short hand built instruction sequences and compares the result
+    against the uxntal each one should come out as. sequences a rule must leave alone are listed with their own text */
+
+#include "uir.h"
+
+#define MAX_INSTRS 8
+
+/* one instruction of a case, kind is an IR_ kind. ops & literals use op/flags & imm, symbols use op & name */
+typedef struct {
+    uint8_t kind;
+    uint8_t op;
+    uint8_t flags;
+    int imm;
+    const char *name;
+} UCheckInstr;
+
+typedef struct {
+    const char *name;
+    int count;
+    UCheckInstr code[MAX_INSTRS];
+    const char *expected;
+} UCheckCase;
+
+#define C_OP(op, modes) {IR_OP, op, modes, 0, NULL}
+#define C_BYTE(val) {IR_LIT, 0, 0, val, NULL}
+#define C_SHORT(val) {IR_LIT, 0, MODE_SHORT, val, NULL}
+#define C_SYM(addr, name) {IR_SYM, addr, 0, 0, name}
+
+static const UCheckCase cases[] = {
+    /* a copy that's stored and then thrown away */
+    {"dup store2 zp", 4, {C_OP(OP_DUP, MODE_SHORT), C_SYM(ADDR_ZP, "uxncle-zp/v0"), C_OP(OP_STZ, MODE_SHORT), C_OP(OP_POP, MODE_SHORT)},
+        ".uxncle-zp/v0 STZ2"},
+    {"dup store2 abs", 4, {C_OP(OP_DUP, MODE_SHORT), C_SYM(ADDR_ABS, "uxncle-heap/f0"), C_OP(OP_STA, MODE_SHORT), C_OP(OP_POP, MODE_SHORT)},
+        ";uxncle-heap/f0 STA2"},
+    {"dup store zp lit", 4, {C_OP(OP_DUP, 0), C_BYTE(0x10), C_OP(OP_STZ, 0), C_OP(OP_POP, 0)},
+        "#10 STZ"},
+    {"dup store abs lit", 4, {C_OP(OP_DUP, 0), C_SHORT(0x1234), C_OP(OP_STA, 0), C_OP(OP_POP, 0)},
+        "#1234 STA"},
+    /* the middle instruction works on the copy, dropping the DUP & POP would change what's stored */
+    {"dup swap store2", 4, {C_OP(OP_DUP, MODE_SHORT), C_OP(OP_SWP, MODE_SHORT), C_OP(OP_STA, MODE_SHORT), C_OP(OP_POP, MODE_SHORT)},
+        "DUP2 SWP2 STA2 POP2"},
+    {"dup load store zp", 4, {C_OP(OP_DUP, 0), C_OP(OP_LDZ, 0), C_OP(OP_STZ, 0), C_OP(OP_POP, 0)},
+        "LDZk STZ POP"},
+    {"dup add store", 4, {C_OP(OP_DUP, 0), C_OP(OP_ADD, MODE_SHORT), C_OP(OP_STA, 0), C_OP(OP_POP, 0)},
+        "DUP ADD2 STA POP"},
+    {"dup rel store", 4, {C_OP(OP_DUP, 0), C_SYM(ADDR_REL, "uxncle-heap/f0"), C_OP(OP_STA, 0), C_OP(OP_POP, 0)},
+        "DUP ,uxncle-heap/f0 STA POP"}
+};
+
+/* returns 1 if the case came out as expected */
+int checkCase(const UCheckCase *cc) {
+    UIRProgram prog;
+    UOutBuf out;
+    int i, passed;
+
+    UI_initProgram(&prog);
+    for (i = 0; i < cc->count; i++) {
+        const UCheckInstr *in = &cc->code[i];
+
+        switch(in->kind) {
+            case IR_OP: UI_op(&prog, (UOpcode)in->op, in->flags); break;
+            case IR_LIT: UI_lit(&prog, in->imm, in->flags == MODE_SHORT); break;
+            case IR_SYM: UI_sym(&prog, (UIRAddr)in->op, UI_symbol(&prog, in->name)); break;
+            default: break;
+        }
+    }
+
+    UI_peephole(&prog);
+    UA_initBuffer(&out, -1);
+    UI_print(&prog, &out);
+
+    /* the printer separates instructions with whitespace, compare word by word */
+    for (i = 0; i < out.len; i++) {
+        if (out.buf[i] == '\n' || out.buf[i] == '\t')
+            out.buf[i] = ' ';
+    }
+    while (out.len > 0 && out.buf[out.len - 1] == ' ')
+        out.buf[--out.len] = '\0';
+    for (i = 0; out.buf[i] == ' '; i++);
+
+    passed = strcmp(out.buf + i, cc->expected) == 0;
+    printf("%-20s %s", cc->name, passed ? "ok\n" : "WRONG, ");
+    if (!passed)
+        printf("expected \"%s\" got \"%s\"\n", cc->expected, out.buf + i);
+
+    UA_freeBuffer(&out);
+    UI_freeProgram(&prog);
+    return passed;
+}
+
+int main(int argc, const char *argv[]) {
+    int i, failed = 0;
+
+    if (argc > 1) {
+        printf("Usage: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < sizeof(cases)/sizeof(UCheckCase); i++) {
+        if (!checkCase(&cases[i]))
+            failed++;
+    }
+
+    if (failed) {
+        printf("%d peephole cases came out wrong\n", failed);
+        return EXIT_FAILURE;
+    }
+
+    printf("every peephole case came out as expected\n");
+    return 0;
+}
@@ -0,0 +1,158 @@
+/* print routine benchmark, prints every int (0..65535) and every char (0..255) with prntint on the embedded vm, checks
+    the output digit for digit against printf and reports how many instructions each prntint took */
+
+#include "ucompiler.h"
+#include "uvm.h"
+
+#define INSTRUCTION_LIMIT 1000000000
+
+typedef struct {
+    const char *name;
+    const char *type;
+    unsigned long count; /* values the loop prints, it stops once the var wraps around to 0 */
+} UPrintCase;
+
+static const UPrintCase cases[] = {
+    {"int", "int", 0x10000},
+    {"char", "char", 0x100}
+};
+
+/* ==================================[[ helpers ]]================================== */
+
+/* reads the whole stream into a null terminated buffer */
+char *readConsole(FILE *file, size_t *len) {
+    char *buffer;
+
+    fseek(file, 0L, SEEK_END);
+    *len = ftell(file);
+    rewind(file);
+
+    buffer = (char*)UM_realloc(NULL, *len + 1);
+    *len = fread(buffer, 1, *len, file);
+    buffer[*len] = '\0';
+    return buffer;
+}
+
+/* every value followed by the space prntint writes after it */
+char *expectedOutput(unsigned long count, size_t *len) {
+    char *buffer = (char*)UM_realloc(NULL, count * 6 + 1);
+    unsigned long i;
+
+    *len = 0;
+    for (i = 0; i < count; i++)
+        *len += sprintf(buffer + *len, "%lu ", i);
+
+    return buffer;
+}
+
+/* the loop runs once per value, with or without the prntint */
+void loopSource(char *out, const char *type, int print) {
+    sprintf(out,
+        "%s v = 0;\n"
+        "bool more = 1;\n"
+        "while (more) {\n"
+        "    %s\n"
+        "    v = v + 1;\n"
+        "    more = v != 0;\n"
+        "}\n", type, print ? "prntint v;" : "");
+}
+
+/* returns the console output or NULL if the program didn't compile or faulted */
+char *runSource(UCompiler *comp, const char *src, unsigned long *instructions, size_t *len) {
+    const uint8_t *rom;
+    size_t romLen;
+    FILE *console;
+    UVM *vm;
+    char *output = NULL;
+
+    if (!UC_compileRom(comp, src, &rom, &romLen)) {
+        printf("compile error: %s\n", comp->err.msg);
+        return NULL;
+    }
+
+    vm = (UVM*)UM_realloc(NULL, sizeof(UVM));
+    console = tmpfile();
+    UV_initVM(vm, comp->rom, console);
+    vm->limit = INSTRUCTION_LIMIT;
+    if (UV_run(vm, ROM_START)) {
+        output = readConsole(console, len);
+        *instructions = vm->instructions;
+    } else {
+        printf("runtime error: %s\n", vm->err);
+    }
+
+    fclose(console);
+    UM_free(vm);
+    return output;
+}
+
+/* ==================================[[ benchmark ]]================================== */
+
+/* returns 1 if every value printed correctly */
+int benchCase(const UPrintCase *pc, int optimize) {
+    char src[256], *output, *expected;
+    unsigned long withPrint = 0, withoutPrint = 0;
+    size_t len, expectedLen, i;
+    UOptions opts;
+    UCompiler comp;
+    int passed = 1;
+
+    memset(&opts, 0, sizeof(opts));
+    if (optimize)
+        opts.foldConstants = opts.peephole = opts.strengthReduce = opts.deadCode = opts.zeroPage = opts.staticFrame = 1;
+    UC_initCompiler(&comp, &opts);
+
+    printf("%-6s %-3s ", pc->name, optimize ? "O" : "O0");
+
+    /* the loop on its own, so its overhead can be taken off */
+    loopSource(src, pc->type, 0);
+    UM_free(runSource(&comp, src, &withoutPrint, &len));
+
+    loopSource(src, pc->type, 1);
+    if ((output = runSource(&comp, src, &withPrint, &len)) == NULL) {
+        UC_freeCompiler(&comp);
+        return 0;
+    }
+
+    expected = expectedOutput(pc->count, &expectedLen);
+    if (len != expectedLen || memcmp(output, expected, len) != 0) {
+        /* point at the first value that's wrong */
+        for (i = 0; i < len && i < expectedLen && output[i] == expected[i]; i++);
+        while (i > 0 && expected[i - 1] != ' ')
+            i--;
+        printf("WRONG OUTPUT at \"%.12s\", expected \"%.12s\"\n", output + i, expected + i);
+        passed = 0;
+    } else {
+        printf("%8lu values %8.1f instructions per prntint  ok\n", pc->count,
+            (double)(withPrint - withoutPrint) / pc->count);
+    }
+
+    UM_free(expected);
+    UM_free(output);
+    UC_freeCompiler(&comp);
+    return passed;
+}
+
+int main(int argc, const char *argv[]) {
+    int i, optimize, failed = 0;
+
+    if (argc > 1) {
+        printf("Usage: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < sizeof(cases)/sizeof(UPrintCase); i++) {
+        for (optimize = 0; optimize <= 1; optimize++) {
+            if (!benchCase(&cases[i], optimize))
+                failed++;
+        }
+    }
+
+    if (failed) {
+        printf("%d runs printed the wrong output\n", failed);
+        return EXIT_FAILURE;
+    }
+
+    printf("every value printed correctly\n");
+    return 0;
+}
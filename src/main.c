@@ -1,60 +1,381 @@
-#include "uparse.h"
-#include "uasm.h"
+/* mmap()'s MAP_ANONYMOUS isn't part of strict c89/posix */
+#define _DEFAULT_SOURCE
 
-char* readFile(const char* path) {
-    FILE* file = fopen(path, "rb");
-    if (file == NULL) {
+#include "ucompiler.h"
+#include "ubatch.h"
+#include "uvm.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* source text, the lexer needs it to end with a '\0' */
+typedef struct {
+    char *src;
+    size_t size; /* bytes of source, not counting the '\0' */
+    size_t mapped; /* length of the mapping, 0 if src was read into a UM_realloc'd buffer */
+} USource;
+
+/* reads everything left in the fd, this works for pipes & terminals where the size isn't known up front */
+void readSource(USource *source, int fd, const char *path) {
+    size_t cap = 0x10000;
+    ssize_t res;
+
+    source->src = (char*)UM_realloc(NULL, cap);
+    source->size = 0;
+    source->mapped = 0;
+
+    for (;;) {
+        /* keep room for the '\0' */
+        if (source->size + 1 >= cap) {
+            cap *= GROW_FACTOR;
+            source->src = (char*)UM_realloc(source->src, cap);
+        }
+
+        res = read(fd, source->src + source->size, cap - source->size - 1);
+        if (res == 0)
+            break;
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            printf("failed to read file \"%s\"!\n", path);
+            exit(74);
+        }
+
+        source->size += res;
+    }
+
+    /* place the null terminator to mark the end of the source */
+    source->src[source->size] = '\0';
+}
+
+/* maps a regular file read-only, returns 0 if it couldn't be mapped */
+int mapSource(USource *source, int fd, size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t length = (size / page + 1) * page; /* always at least one byte past the end of the file */
+    void *base;
+
+    /* reserve zero'd pages first, then map the file over the start of them. the bytes past the end of the file are
+        zero whether they're in the file's last page or the extra anonymous one, so the '\0' comes for free */
+    base = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return 0;
+
+    if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, length);
+        return 0;
+    }
+
+    source->src = (char*)base;
+    source->size = size;
+    source->mapped = length;
+    return 1;
+}
+
+/* "-" reads from stdin */
+void loadSource(USource *source, const char *path) {
+    struct stat info;
+    int fd;
+
+    if (strcmp(path, "-") == 0) {
+        readSource(source, STDIN_FILENO, "<stdin>");
+        return;
+    }
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
         fprintf(stderr, "Could not open file \"%s\".\n", path);
         exit(74);
     }
 
-    /* first, we need to know how big our file is */
-    fseek(file, 0L, SEEK_END);
-    size_t fileSize = ftell(file);
-    rewind(file);
+    /* only non-empty regular files can be mapped, everything else is read */
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0 || !mapSource(source, fd, info.st_size))
+        readSource(source, fd, path);
+
+    close(fd);
+}
+
+void freeSource(USource *source) {
+    if (source->mapped)
+        munmap(source->src, source->mapped);
+    else
+        UM_free(source->src);
+}
+
+void writeTal(const char *tal, size_t len, const char *path) {
+    UOutBuf out;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1) {
+        fprintf(stderr, "Could not open \"%s\".\n", path);
+        exit(74);
+    }
+
+    UA_initBuffer(&out, fd);
+    UA_write(&out, tal, len);
+    if (!UA_flush(&out)) {
+        fprintf(stderr, "Could not write \"%s\".\n", path);
+        exit(74);
+    }
+
+    UA_freeBuffer(&out);
+    close(fd);
+}
+
+void writeRom(URom *rom, const char *path) {
+    FILE *out;
+
+    if ((out = fopen(path, "wb")) == NULL || !UR_writeRom(rom, out)) {
+        fprintf(stderr, "Could not write rom \"%s\".\n", path);
+        exit(74);
+    }
+    fclose(out);
+}
 
-    /* allocate our buffer (+1 for NULL byte) */
-    char *buffer = (char*)malloc(fileSize + 1);
-    if (buffer == NULL) {
-        fprintf(stderr, "failed to allocate!");
+/* runs the rom on the embedded vm, the program's output goes to stdout and the stats to stderr */
+void runRom(URom *rom) {
+    UVM *vm = (UVM*)UM_realloc(NULL, sizeof(UVM));
+
+    UV_initVM(vm, rom, stdout);
+    if (!UV_run(vm, ROM_START)) {
+        fflush(stdout);
+        fprintf(stderr, "\nRuntime error after %lu instructions!\n\t%s\n", vm->instructions, vm->err);
         exit(EXIT_FAILURE);
     }
 
-    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+    fputc('\n', stdout);
+    fflush(stdout);
+    fprintf(stderr, "rom: %d bytes\n", UR_romSize(rom));
+    UV_printStats(vm, stderr);
+    UM_free(vm);
+}
+
+/* "dir" + "src/foo.uxc" -> "dir/foo.tal" */
+char *batchOutPath(const char *dir, const char *path, const char *ext) {
+    const char *start = strrchr(path, '/');
+    const char *end = strrchr(path, '.');
+    size_t dirLen = strlen(dir), len;
+    char *out;
+
+    start = start ? start + 1 : path;
+    if (end == NULL || end < start)
+        end = start + strlen(start);
+    len = end - start;
+
+    /* don't double up the separator for "-o outdir/" */
+    while (dirLen > 1 && dir[dirLen - 1] == '/')
+        dirLen--;
 
-    if (bytesRead < fileSize) {
-        printf("failed to read file \"%s\"!\n", path);
+    out = (char*)UM_realloc(NULL, dirLen + len + strlen(ext) + 2);
+    sprintf(out, "%.*s/%.*s%s", (int)dirLen, dir, (int)len, start, ext);
+    return out;
+}
+
+/* compiles every source into outDir, diagnostics are printed in the order the sources were given */
+int compileBatch(const char **inputs, int count, const char *outDir, int threads, UOptions *opts, int emitRom,
+        UCache *cache) {
+    UBatchJob *jobs = (UBatchJob*)UM_realloc(NULL, sizeof(UBatchJob) * count);
+    USource *srcs = (USource*)UM_realloc(NULL, sizeof(USource) * count);
+    UInternTable outNames;
+    int i, failed;
+
+    if (mkdir(outDir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create \"%s\".\n", outDir);
         exit(74);
     }
 
-    /* place the null terminator to mark the end of the source */
-    buffer[bytesRead] = '\0';
+    UT_initInternTable(&outNames);
+    for (i = 0; i < count; i++) {
+        jobs[i].name = inputs[i];
+        jobs[i].outPath = batchOutPath(outDir, inputs[i], emitRom ? ".rom" : ".tal");
+
+        /* two sources writing the same output would make the result depend on which one finished last */
+        if (UT_intern(&outNames, (char*)jobs[i].outPath, strlen(jobs[i].outPath)) != outNames.sCount - 1) {
+            fprintf(stderr, "\"%s\" would overwrite the output of an earlier source (%s).\n", inputs[i], jobs[i].outPath);
+            exit(EXIT_FAILURE);
+        }
+    }
+    UT_freeInternTable(&outNames);
+
+    for (i = 0; i < count; i++) {
+        loadSource(&srcs[i], inputs[i]);
+        jobs[i].src = srcs[i].src;
+    }
+
+    failed = UB_compileBatch(jobs, count, threads, opts, emitRom, cache);
+
+    for (i = 0; i < count; i++) {
+        if (!jobs[i].ok)
+            printf("%s\n", jobs[i].msg);
+        UM_free((char*)jobs[i].outPath);
+        freeSource(&srcs[i]);
+    }
+
+    printf("Compiled %d of %d sources into %s\n", count - failed, count, outDir);
+    UM_free(jobs);
+    UM_free(srcs);
+    return failed;
+}
 
-    /* close the file handler and return the source buffer */
-    fclose(file);
-    return buffer;
+void printUsage(const char *name) {
+    printf("Usage: %s [OPTIONS] [SOURCE] [OUT]\n       %s [OPTIONS] [-j N] SOURCES... -o DIR\n"
+        "Compiler for the Uxntal assembly language, SOURCE can be - for stdin.\n"
+        "Options:\n"
+        "\t-O\t\tenable all optimizations\n"
+        "\t--fold\t\tfold constant expressions\n"
+        "\t--peephole\trewrite redundant instruction sequences\n"
+        "\t--strength\tturn multiplies & divides by constants into shifts\n"
+        "\t--dead-code\tremove unreachable code, dead stores & unused locals\n"
+        "\t--zeropage\tpromote the most used locals into the zero-page\n"
+        "\t--static-frame\tlay out every local at a fixed address\n"
+        "\t--mem-stats\treport parse arena usage\n"
+        "\t--rom\t\tassemble the generated uxntal and write a rom to OUT\n"
+        "\t--run\t\trun the program on the embedded vm and report its stats, OUT is optional\n"
+        "\t-o DIR\t\tcompile every SOURCE into DIR/<name>.tal (or .rom)\n"
+        "\t-j N\t\tcompile the sources on N threads\n"
+        "\t--cache DIR\treuse outputs of unchanged sources from DIR, storing new ones there\n"
+        "\t--cache-size MB\tevict the least recently used outputs past this size (default %d)\n"
+        "\t--cache-stats\treport cache hits & usage\n", name, name, CACHE_DEFAULT_SIZE / (1024 * 1024));
+    exit(EXIT_FAILURE);
 }
 
 int main(int argc, const char *argv[]) {
-    const char *out, *in;
-    char *src;
+    const char *out = NULL, *in = NULL, *outDir = NULL;
+    const char **inputs = (const char**)UM_realloc(NULL, sizeof(char*) * argc);
+    const char *cacheDir = NULL;
+    size_t cacheSize = CACHE_DEFAULT_SIZE;
+    UCache cache;
+    int inCount = 0, threads = 1, cacheStats = 0;
+    USource src;
+    UOptions opts;
+    UCompiler comp;
+    const char *tal = NULL;
+    const uint8_t *rom = NULL;
+    size_t len = 0;
+    int memStats = 0, emitRom = 0, run = 0;
+    int i, ok;
 
-    if (argc < 3) {
-        printf("Usage: %s [SOURCE] [OUT]\nCompiler for the Uxntal assembly language.", argv[0]);
+    memset(&opts, 0, sizeof(opts));
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O") == 0)
+            opts.foldConstants = opts.peephole = opts.strengthReduce = opts.deadCode = opts.zeroPage = opts.staticFrame = 1;
+        else if (strcmp(argv[i], "--peephole") == 0)
+            opts.peephole = 1;
+        else if (strcmp(argv[i], "--strength") == 0)
+            opts.strengthReduce = 1;
+        else if (strcmp(argv[i], "--dead-code") == 0)
+            opts.deadCode = 1;
+        else if (strcmp(argv[i], "--fold") == 0)
+            opts.foldConstants = 1;
+        else if (strcmp(argv[i], "--zeropage") == 0)
+            opts.zeroPage = 1;
+        else if (strcmp(argv[i], "--static-frame") == 0)
+            opts.staticFrame = 1;
+        else if (strcmp(argv[i], "--mem-stats") == 0)
+            memStats = 1;
+        else if (strcmp(argv[i], "--rom") == 0)
+            emitRom = 1;
+        else if (strcmp(argv[i], "--run") == 0)
+            run = 1;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outDir = argv[++i];
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cacheDir = argv[++i];
+        else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+            cacheSize = (size_t)atol(argv[++i]) * 1024 * 1024;
+        else if (strcmp(argv[i], "--cache-stats") == 0)
+            cacheStats = 1;
+        else if (argv[i][0] == '-' && strcmp(argv[i], "-") != 0)
+            printUsage(argv[0]);
+        else
+            inputs[inCount++] = argv[i];
+    }
+
+    if (cacheStats && cacheDir == NULL)
+        printUsage(argv[0]);
+
+    if (cacheDir != NULL && !UK_openCache(&cache, cacheDir, cacheSize)) {
+        fprintf(stderr, "Could not open cache \"%s\".\n", cacheDir);
+        exit(74);
+    }
+
+    if (outDir != NULL) {
+        /* every source is read up front, so stdin & --run don't fit in a batch */
+        if (inCount == 0 || run || threads < 1)
+            printUsage(argv[0]);
+        for (i = 0; i < inCount; i++) {
+            if (strcmp(inputs[i], "-") == 0)
+                printUsage(argv[0]);
+        }
+
+        i = compileBatch(inputs, inCount, outDir, threads, &opts, emitRom, cacheDir ? &cache : NULL);
+        UM_free(inputs);
+        if (cacheDir != NULL) {
+            if (cacheStats)
+                UK_printStats(&cache, stdout);
+            UK_closeCache(&cache);
+        }
+        return i ? EXIT_FAILURE : 0;
+    }
+
+    if (inCount > 2)
+        printUsage(argv[0]);
+    in = inCount > 0 ? inputs[0] : NULL;
+    out = inCount > 1 ? inputs[1] : NULL;
+    UM_free(inputs);
+
+    if (in == NULL || (out == NULL && !run))
+        printUsage(argv[0]);
+
+    loadSource(&src, in);
+    UC_initCompiler(&comp, &opts);
+    if (cacheDir != NULL)
+        comp.cache = &cache;
+
+    /* OUT gets the uxntal unless --rom was given, even with --run, which then assembles the uxntal it already has */
+    if (out != NULL && !emitRom) {
+        if ((ok = UC_compileTal(&comp, src.src, &tal, &len)))
+            writeTal(tal, len, out);
+        if (ok && run)
+            ok = UC_assembleTal(&comp, &rom, &len);
+    } else {
+        ok = UC_compileRom(&comp, src.src, &rom, &len);
+    }
+
+    if (!ok) {
+        printf("%s\n", comp.err.msg);
         exit(EXIT_FAILURE);
     }
 
-    in = argv[1];
-    out = argv[2];
-    src = readFile(in);
+    if (out != NULL && emitRom)
+        writeRom(comp.rom, out);
 
-    UASTRootNode *tree = UP_parseSource(src);
-    UA_genTal(tree, fopen(out, "w"));
+    if (run)
+        runRom(comp.rom);
 
-    /* clean up */
-    UP_freeTree((UASTNode*)tree);
-    free(src);
+    if (memStats) {
+        printf("arena: %lu bytes used (peak %lu), %lu bytes reserved (peak %lu) in %d chunks\n",
+            (unsigned long)comp.treeSize, (unsigned long)comp.arena.peak,
+            (unsigned long)comp.arena.reserved, (unsigned long)comp.arena.peakReserved, comp.arena.chunks);
+    }
 
-    printf("Compiled successfully! Wrote generated uxntal to %s\n", out);
+    if (out != NULL && !run) {
+        if (emitRom)
+            printf("Compiled successfully! Wrote %lu byte rom to %s\n", (unsigned long)len, out);
+        else
+            printf("Compiled successfully! Wrote generated uxntal to %s\n", out);
+    }
+
+    if (cacheStats)
+        UK_printStats(&cache, stdout);
+
+    /* clean up */
+    if (cacheDir != NULL)
+        UK_closeCache(&cache);
+    UC_freeCompiler(&comp);
+    freeSource(&src);
     return 0;
 }
\ No newline at end of file
@@ -1,215 +1,405 @@
+#include "umem.h"
 #include "uasm.h"
 #include "uparse.h"
+#include "uir.h"
+
+#include <unistd.h>
+#include <errno.h>
 
 /* compiler state */
 typedef struct {
-    FILE *out;
-    UScope *scopes[MAX_SCOPES];
+    UOutBuf *out;
+    UIRProgram prog; /* main-prg is lowered into this, the runtime routines are still written as text */
+    UScope **scopes; /* stack of active scopes */
     int sCount;
+    int sCap;
+    uint16_t frameTop; /* frame offset of the end of the innermost scope */
+    UOptions *opts;
+    UError *err;
+    uint8_t *frameLbls; /* frame offsets that need a label under @uxncle-heap, only used with opts->staticFrame */
     int pushed; /* current bytes on the stack */
-    int jmpID;
+    unsigned int routines; /* ROUTINE_BITs of every runtime routine called, see callRoutine() */
 } UCompState;
 
+/* runtime subroutines the generated code calls, only the ones it references are written out */
+typedef enum {
+    RT_PRINT_DECIMAL,
+    RT_PRINT_BYTE,
+    RT_ALLOC,
+    RT_DEALLOC,
+    RT_PEEK_SHORT,
+    RT_POKE_SHORT,
+    RT_PEEK,
+    RT_POKE,
+    RT_MAX
+} URoutine;
+
+#define ROUTINE_BIT(routine) (1u << (routine))
+
+typedef struct {
+    const char *name;
+    unsigned int deps; /* ROUTINE_BITs of the routines this one calls */
+    const char *body; /* everything after its label */
+} URoutineDef;
+
 static const char preamble[] =
     "|10 @Console [ &pad $8 &char $1 &byte $1 &short $2 &string $2 ]\n"
     "|0000\n"
-    "@number [ &started $1 ]\n"
-    "@uxncle [ &heap $2 ]\n"
+    "@uxncle [ &heap $2 ]\n";
+    /* promoted vars are declared here, see writeZeroPage() */
+
+static const char prgPreamble[] =
     "|0100\n"
-    "@main-prg\n"
-        /* setup mem lib */
-        ";uxncle-heap .uxncle/heap STZ2\n";
+    "@main-prg\n";
+
+/* setup mem lib, the static frame doesn't need the heap pointer */
+static const char heapPreamble[] =
+    ";uxncle-heap .uxncle/heap STZ2\n";
 
 static const char postamble[] =
     "\n"
-    "BRK\n"
-        "@print-decimal\n"
-        "\t#00 .number/started STZ\n"
-        "\tDUP2 #2710 DIV2 DUP2 ,&digit JSR #2710 MUL2 SUB2\n"
-        "\tDUP2 #03e8 DIV2 DUP2 ,&digit JSR #03e8 MUL2 SUB2\n"
-        "\tDUP2 #0064 DIV2 DUP2 ,&digit JSR #0064 MUL2 SUB2\n"
-        "\tDUP2 #000a DIV2 DUP2 ,&digit JSR #000a MUL2 SUB2\n"
-        "\t,&digit JSR\n"
-        "\t.number/started LDZ ,&end JCN\n"
-        "\tLIT '0 .Console/char DEO\n"
-        "\t&end\n"
-    "JMP2r\n"
+    "BRK\n";
+    /* followed by the routines the program called, see writeRoutines() */
+
+static const URoutineDef routines[] = {
+    /* prints a short without leading zeros. a byte goes to print-byte, otherwise it's at least 3 digits and the compares
+        pick the first one, so no digit has to check if one was printed yet. each digit is one DIV2k with the quotient
+        kept on the return stack while the remainder is taken, the last two are print-byte's */
+    {"print-decimal", ROUTINE_BIT(RT_PRINT_BYTE),
+        "\tOVR ,&wide JCN\n"
+        "\tNIP ;print-byte JMP2\n"
+        "\t&wide\n"
+        "\tDUP2 #03e8 LTH2 ,&d100 JCN\n"
+        "\tDUP2 #2710 LTH2 ,&d1000 JCN\n"
+        "\t#2710 ,&digit JSR\n"
+        "\t&d1000 #03e8 ,&digit JSR\n"
+        "\t&d100 #0064 ,&digit JSR\n"
+        "\tNIP ;print-byte/d10 JMP2\n"
     "\t&digit\n"
-        "\tSWP POP\n"
-        "\tDUP .number/started LDZ ORA #02 JCN\n"
-        "\tPOP JMP2r\n"
-        "\tLIT '0 ADD .Console/char DEO\n"
-        "\t#01 .number/started STZ\n"
-    "JMP2r\n"
+        "\tDIV2k STH2k MUL2 SUB2 STH2r NIP LIT '0 ADD .Console/char DEO\n"
+    "JMP2r\n"},
+    /* prints a byte without leading zeros, chars & bools are printed with this directly */
+    {"print-byte", 0,
+        "\tDUP #0a LTH ,&d1 JCN\n"
+        "\tDUP #64 LTH ,&d10 JCN\n"
+        "\t#64 DIVk STHk MUL SUB STHr LIT '0 ADD .Console/char DEO\n"
+        "\t&d10 #0a DIVk STHk MUL SUB STHr LIT '0 ADD .Console/char DEO\n"
+        "\t&d1 LIT '0 ADD .Console/char DEO\n"
+    "JMP2r\n"},
     /* start of thin memory library */
-    "@alloc-uxncle\n" /* this subroutine handles allocating memory on the heap, expects the size (short) */
+    {"alloc-uxncle", 0, /* this subroutine handles allocating memory on the heap, expects the size (short) */
         ".uxncle/heap LDZ2\n" /* load the heap pointer onto the stack */
         "ADD2\n" /* add the size */
         ".uxncle/heap STZ2\n" /* store the new heap pointer */
-        "JMP2r\n" /* return */
-    "@dealloc-uxncle\n" /* this subroutine handles deallocating memory from the heap, expects the size (short) */
+        "JMP2r\n"}, /* return */
+    {"dealloc-uxncle", 0, /* this subroutine handles deallocating memory from the heap, expects the size (short) */
         ".uxncle/heap LDZ2\n" /* load the heap pointer onto the stack */
         "SWP2\n" /* move the heap pointer behind the size, so when we subtract it'll be heap - size, not size - heap */
         "SUB2\n" /* sub the size from the address */
         ".uxncle/heap STZ2\n" /* store the new heap pointer */
-        "JMP2r\n" /* return */
-    "@peek-uxncle-short\n" /* this subroutine handles loading a short from the heap and pushing it onto the stack, expects  the offset (short) */
+        "JMP2r\n"}, /* return */
+    {"peek-uxncle-short", 0, /* this subroutine handles loading a short from the heap and pushing it onto the stack, expects  the offset (short) */
         ".uxncle/heap LDZ2\n" /* load the heap pointer onto the stack */
         "SWP2\n" /* move the heap pointer behind the offset */
         "SUB2\n"
         "LDA2\n" /* loads the short from the heap onto the stack */
-        "JMP2r\n" /* return */
-    "@poke-uxncle-short\n" /* this subroutine handles popping a short from the stack and saving it into the heap, expects the value (short) and the offset (short) */
+        "JMP2r\n"}, /* return */
+    {"poke-uxncle-short", 0, /* this subroutine handles popping a short from the stack and saving it into the heap, expects the value (short) and the offset (short) */
         ".uxncle/heap LDZ2\n" /* load the heap pointer onto the stack */
         "SWP2\n" /* move the heap pointer behind the offset */
         "SUB2\n"
         "STA2\n" /* stores the value into the address */
-        "JMP2r\n" /* return */
-    "@peek-uxncle\n" /* this subroutine handles loading a byte from the heap and pushing it onto the stack, expects the offset (short) */
+        "JMP2r\n"}, /* return */
+    {"peek-uxncle", 0, /* this subroutine handles loading a byte from the heap and pushing it onto the stack, expects the offset (short) */
         ".uxncle/heap LDZ2\n" /* load the heap pointer onto the stack */
         "SWP2\n" /* move the heap pointer behind the offset */
         "SUB2\n"
         "LDA\n" /* loads the byte from the heap onto the stack */
-        "JMP2r\n" /* return */
-    "@poke-uxncle\n" /* this subroutine handles popping a byte from the stack and saving it into the heap, expects the value (byte) and the offset (short) */
+        "JMP2r\n"}, /* return */
+    {"poke-uxncle", 0, /* this subroutine handles popping a byte from the stack and saving it into the heap, expects the value (byte) and the offset (short) */
         ".uxncle/heap LDZ2\n" /* load the heap pointer onto the stack */
         "SWP2\n" /* move the heap pointer behind the offset */
         "SUB2\n"
         "STA\n" /* stores the value into the address */
-        "JMP2r\n" /* return */
+        "JMP2r\n"} /* return */
+};
+
+static const char heapPostamble[] =
     "@uxncle-heap\n"
     "|ffff &end";
 
 void compileAST(UCompState *state, UASTNode *node);
 UVarType compileExpression(UCompState *state, UASTNode *node);
 
+/* ==================================[[ output buffer ]]================================== */
+
+static const char hexDigits[] = "0123456789abcdef";
+
+void UA_initBuffer(UOutBuf *out, int fd) {
+    out->cap = 0x4000;
+    out->len = 0;
+    out->buf = (char*)UM_realloc(NULL, out->cap);
+    out->buf[0] = '\0';
+    out->fd = fd;
+}
+
+void UA_freeBuffer(UOutBuf *out) {
+    UM_free(out->buf);
+}
+
+/* makes room for len more bytes & the null terminator */
+void reserveBuffer(UOutBuf *out, size_t len) {
+    if (out->len + len + 1 <= out->cap)
+        return;
+
+    while (out->len + len + 1 > out->cap)
+        out->cap *= GROW_FACTOR;
+    out->buf = (char*)UM_realloc(out->buf, out->cap);
+}
+
+void UA_write(UOutBuf *out, const char *str, size_t len) {
+    reserveBuffer(out, len);
+    memcpy(out->buf + out->len, str, len);
+    out->len += len;
+    out->buf[out->len] = '\0';
+}
+
+void UA_puts(UOutBuf *out, const char *str) {
+    UA_write(out, str, strlen(str));
+}
+
+void UA_putc(UOutBuf *out, char c) {
+    reserveBuffer(out, 1);
+    out->buf[out->len++] = c;
+    out->buf[out->len] = '\0';
+}
+
+void UA_hex8(UOutBuf *out, int val) {
+    char *dst;
+
+    reserveBuffer(out, 2);
+    dst = out->buf + out->len;
+    dst[0] = hexDigits[(val >> 4) & 0xf];
+    dst[1] = hexDigits[val & 0xf];
+    dst[2] = '\0';
+    out->len += 2;
+}
+
+void UA_hex16(UOutBuf *out, int val) {
+    char *dst;
+
+    reserveBuffer(out, 4);
+    dst = out->buf + out->len;
+    dst[0] = hexDigits[(val >> 12) & 0xf];
+    dst[1] = hexDigits[(val >> 8) & 0xf];
+    dst[2] = hexDigits[(val >> 4) & 0xf];
+    dst[3] = hexDigits[val & 0xf];
+    dst[4] = '\0';
+    out->len += 4;
+}
+
+void UA_hex(UOutBuf *out, unsigned int val) {
+    char tmp[sizeof(unsigned int) * 2];
+    int i = sizeof(tmp);
+
+    /* digits are written backwards */
+    do {
+        tmp[--i] = hexDigits[val & 0xf];
+        val >>= 4;
+    } while (val);
+
+    UA_write(out, tmp + i, sizeof(tmp) - i);
+}
+
+void UA_dec(UOutBuf *out, unsigned int val) {
+    char tmp[sizeof(unsigned int) * 3];
+    int i = sizeof(tmp);
+
+    do {
+        tmp[--i] = '0' + val % 10;
+        val /= 10;
+    } while (val);
+
+    UA_write(out, tmp + i, sizeof(tmp) - i);
+}
+
+int UA_flush(UOutBuf *out) {
+    size_t written = 0;
+    ssize_t res;
+
+    if (out->fd == -1)
+        return 1;
+
+    /* write() can stop early, so keep going until everything is out */
+    while (written < out->len) {
+        res = write(out->fd, out->buf + written, out->len - written);
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        written += res;
+    }
+
+    out->len = 0;
+    out->buf[0] = '\0';
+    return 1;
+}
+
 /* ==================================[[ generic helper functions ]]================================== */
 
+/* frees everything UA_genTal() allocated, the output buffer belongs to the caller */
+void freeCompState(UCompState *state) {
+    UI_freeProgram(&state->prog);
+    UM_freearray(state->scopes);
+    UM_freearray(state->frameLbls);
+}
+
 /* throws a compiler error */
 void cError(UCompState *state, const char *fmt, ...) {
     va_list args;
+
+    freeCompState(state);
     va_start(args, fmt);
-    printf("Compiler error!\n\t");
-    vprintf(fmt, args);
+    UE_raise(state->err, "Compiler error", NULL, 0, 0, fmt, args);
     va_end(args);
-    exit(EXIT_FAILURE);
 }
 
 void cErrorNode(UCompState *state, UASTNode *node, const char *fmt, ...) {
     va_list args;
+
+    freeCompState(state);
     va_start(args, fmt);
-    printf("Compiler error at '%.*s' on line %d\n\t", node->tkn.len, node->tkn.str, node->tkn.line);
-    vprintf(fmt, args);
+    UE_raise(state->err, "Compiler error", node->tkn.str, node->tkn.len, node->tkn.line, fmt, args);
     va_end(args);
-    exit(EXIT_FAILURE);
 }
 
-void writeIntLit(UCompState *state, uint16_t lit) {
-    fprintf(state->out, "#%.4x ", lit);
-    state->pushed += SIZE_INT;
+/* ==================================[[ emit helpers ]]================================== */
+
+void emitOp(UCompState *state, UOpcode op, int modes) {
+    UI_op(&state->prog, op, modes);
 }
 
-void writeByteLit(UCompState *state, uint8_t lit) {
-    fprintf(state->out, "#%.2x ", lit);
-    state->pushed += SIZE_CHAR;
+/* emits the literal address of a named label, eg. ";uxncle-heap/f0" */
+void emitSym(UCompState *state, UIRAddr addr, const char *fmt, ...) {
+    char name[64];
+    va_list args;
+
+    va_start(args, fmt);
+    vsprintf(name, fmt, args);
+    va_end(args);
+
+    UI_sym(&state->prog, addr, UI_symbol(&state->prog, name));
 }
 
-uint16_t getSize(UCompState *state, UVar *var) {
-    switch(var->type) {
-        case TYPE_CHAR: case TYPE_BOOL: return 1;
-        case TYPE_INT: return 2;
-        default:
-            cError(state, "unknown type! [%d]", var->type);
-            return 0;
-    }
+/* calls a runtime subroutine, it's up to the caller to track what it pops & pushes */
+void callRoutine(UCompState *state, URoutine routine) {
+    state->routines |= ROUTINE_BIT(routine);
+    UI_sym(&state->prog, ADDR_ABS, UI_symbol(&state->prog, routines[routine].name));
+    UI_op(&state->prog, OP_JSR, MODE_SHORT);
 }
 
-uint16_t getScopeSize(UCompState *state, UScope *scope) {
-    uint16_t size = 0;
-    int i;
+void writeIntLit(UCompState *state, uint16_t lit) {
+    UI_lit(&state->prog, lit, 1);
+    state->pushed += SIZE_INT;
+}
 
-    /* add up all the sizes */
-    for (i = 0; i < scope->vCount; i++)
-        size += getSize(state, &scope->vars[i]);
-    
-    return size;
+void writeByteLit(UCompState *state, uint8_t lit) {
+    UI_lit(&state->prog, lit, 0);
+    state->pushed += SIZE_CHAR;
 }
 
 void pushScope(UCompState *state, UScope *scope) {
+    UM_growarray(UScope*, state->scopes, state->sCount, state->sCap);
     state->scopes[state->sCount++] = scope;
-    int scopeSize = getScopeSize(state, scope);
+    state->frameTop = scope->base + scope->size;
 
-    if (scopeSize > 0) {
-        writeIntLit(state, getScopeSize(state, scope));
-        fwrite(";alloc-uxncle JSR2\n", 19, 1, state->out);
+    /* the static frame is laid out at compile time, so entering a scope is free */
+    if (scope->size > 0 && !state->opts->staticFrame) {
+        writeIntLit(state, scope->size);
+        callRoutine(state, RT_ALLOC);
         state->pushed -= SIZE_INT;
     }
 }
 
 void popScope(UCompState *state) {
     UScope *scope = state->scopes[--state->sCount];
-    int scopeSize = getScopeSize(state, scope);
+    state->frameTop = scope->base;
 
-    if (scopeSize > 0) {
-        writeIntLit(state, scopeSize);
-        fwrite(";dealloc-uxncle JSR2\n", 21, 1, state->out);
+    if (scope->size > 0 && !state->opts->staticFrame) {
+        writeIntLit(state, scope->size);
+        callRoutine(state, RT_DEALLOC);
         state->pushed -= SIZE_INT;
     }
 }
 
-uint16_t getOffset(UCompState *state, int scope, int var) {
-    uint16_t offsetAddr = 0; 
-    int i, z;
-
-    /* sanity check */
-    if (state->sCount < scope || state->scopes[scope]->vCount < var)
-        cError(state, "Invalid variable id!");
-
-    /* walk scopes adding the size of the data on the heap */
-    for (i = scope; i >= 0; i--) 
-        for (z = var; z >= 0; z--)
-            offsetAddr += getSize(state, &state->scopes[i]->vars[z]);
-
-    return offsetAddr;
+uint16_t getSize(UCompState *state, UVarType type) {
+    switch(type) {
+        case TYPE_CHAR: return SIZE_CHAR;
+        case TYPE_BOOL: return SIZE_BOOL;
+        case TYPE_INT: return SIZE_INT;
+        default:
+            cError(state, "unknown type! [%d]", type);
+            return 0;
+    }
 }
 
-void getIntVar(UCompState *state, int scope, int var) {
-    uint16_t offsetAddr = getOffset(state, scope, var);
-
-    writeIntLit(state, offsetAddr); /* write the offset */
-    fprintf(state->out, ";peek-uxncle-short JSR2\n"); /* call the mem lib */
+/* returns the offset of the var from the current heap pointer */
+uint16_t getOffset(UCompState *state, int scope, int var) {
+    return state->frameTop - state->scopes[scope]->vars[var].offset;
 }
 
 UVar* getVarByID(UCompState *state, int scope, int var) {
     return &state->scopes[scope]->vars[var];
 }
 
-void setIntVar(UCompState *state, int scope, int var) {
-    uint16_t offsetAddr = getOffset(state, scope, var);
-
-    writeIntLit(state, offsetAddr); /* write the offset */
-    fprintf(state->out, ";poke-uxncle-short JSR2\n"); /* call the mem lib */
-    state->pushed -= SIZE_INT + SIZE_INT; /* pops the offset (short) & the value (short) */
-}
-
-void setVar(UCompState *state, int scope, int var, UVarType type) {
-    switch(type) {
-        case TYPE_INT: setIntVar(state, scope, var); break;
-        default:
-            cError(state, "Unimplemented setter for type '%s'", getTypeName(type));
+/* loads the var onto the stack, chars & bools are a byte wide so they use the byte modes & mem lib routines */
+UVarType getVar(UCompState *state, int scope, int var) {
+    UVar *rawVar = getVarByID(state, scope, var);
+    uint16_t size = getSize(state, rawVar->type);
+    int mode = size == SIZE_INT ? MODE_SHORT : 0;
+
+    if (rawVar->zeroPage != -1) {
+        /* promoted vars are loaded inline */
+        emitSym(state, ADDR_ZP, "uxncle-zp/v%d", rawVar->zeroPage);
+        emitOp(state, OP_LDZ, mode);
+    } else if (state->opts->staticFrame) {
+        /* vars in the static frame have a fixed address */
+        state->frameLbls[rawVar->offset] = 1;
+        emitSym(state, ADDR_ABS, "uxncle-heap/f%x", rawVar->offset);
+        emitOp(state, OP_LDA, mode);
+    } else {
+        writeIntLit(state, getOffset(state, scope, var)); /* write the offset */
+        callRoutine(state, size == SIZE_INT ? RT_PEEK_SHORT : RT_PEEK); /* call the mem lib */
+        state->pushed -= SIZE_INT; /* pops the offset (short) */
     }
+
+    state->pushed += size;
+    return rawVar->type;
 }
 
-UVarType getVar(UCompState *state, int scope, int var) {
+/* pops the value (which should already be the var's type) into the var */
+void setVar(UCompState *state, int scope, int var) {
     UVar *rawVar = getVarByID(state, scope, var);
-
-    switch(rawVar->type) {
-        case TYPE_INT: getIntVar(state, scope, var); break;
-        default:
-            cError(state, "Unimplemented getter for type '%s'", getTypeName(rawVar->type));
+    uint16_t size = getSize(state, rawVar->type);
+    int mode = size == SIZE_INT ? MODE_SHORT : 0;
+
+    if (rawVar->zeroPage != -1) {
+        /* promoted vars are stored inline */
+        emitSym(state, ADDR_ZP, "uxncle-zp/v%d", rawVar->zeroPage);
+        emitOp(state, OP_STZ, mode);
+    } else if (state->opts->staticFrame) {
+        /* vars in the static frame have a fixed address */
+        state->frameLbls[rawVar->offset] = 1;
+        emitSym(state, ADDR_ABS, "uxncle-heap/f%x", rawVar->offset);
+        emitOp(state, OP_STA, mode);
+    } else {
+        writeIntLit(state, getOffset(state, scope, var)); /* write the offset */
+        callRoutine(state, size == SIZE_INT ? RT_POKE_SHORT : RT_POKE); /* call the mem lib */
+        state->pushed -= SIZE_INT; /* pops the offset (short) */
     }
-    
-    return rawVar->type;
+
+    state->pushed -= size; /* pops the value */
 }
 
 UVarType compileVar(UCompState *state, UASTNode *node) {
@@ -229,7 +419,7 @@ int tryTypeCast(UCompState *state, UVarType from, UVarType to) {
     switch(to) {
         case TYPE_CHAR:
             switch(from) {
-                case TYPE_INT: fprintf(state->out, "SWP POP\n"); state->pushed -= 1; break; /* moves the most significant byte to the front and pops it */
+                case TYPE_INT: emitOp(state, OP_SWP, 0); emitOp(state, OP_POP, 0); state->pushed -= 1; break; /* moves the most significant byte to the front and pops it */
                 case TYPE_BOOL: break; /* TYPE_BOOL is already the same size */
                 default: return 0;
             }
@@ -237,14 +427,14 @@ int tryTypeCast(UCompState *state, UVarType from, UVarType to) {
         case TYPE_INT:
             switch(from) {
                 /* the process to convert TYPE_CHAR & TYPE_BOOL to TYPE_INT is the same */
-                case TYPE_BOOL: case TYPE_CHAR: fprintf(state->out, "#00 SWP\n"); state->pushed += 1; break; /* pushes an empty byte to the stack and moves it to the most significant byte */
+                case TYPE_BOOL: case TYPE_CHAR: UI_lit(&state->prog, 0x00, 0); emitOp(state, OP_SWP, 0); state->pushed += 1; break; /* pushes an empty byte to the stack and moves it to the most significant byte */
                 default: return 0;
             }
             break;
         case TYPE_BOOL: /* do a comparison if the value is not equal to zero */
             switch(from) {
-                case TYPE_INT: fprintf(state->out, "#0000 NEQ2\n"); state->pushed -= 1; break;
-                case TYPE_CHAR: fprintf(state->out, "#00 NEQ\n"); break;
+                case TYPE_INT: UI_lit(&state->prog, 0x0000, 1); emitOp(state, OP_NEQ, MODE_SHORT); state->pushed -= 1; break;
+                case TYPE_CHAR: UI_lit(&state->prog, 0x00, 0); emitOp(state, OP_NEQ, 0); break;
                 default: return 0;
             }
             break;
@@ -255,21 +445,30 @@ int tryTypeCast(UCompState *state, UVarType from, UVarType to) {
 }
 
 int newLbl(UCompState *state) {
-    return state->jmpID++;
+    return UI_newLabel(&state->prog);
 }
 
 void defineSubLbl(UCompState *state, int subLblID) {
-    fprintf(state->out, "&lbl%d\n", subLblID);
+    UI_label(&state->prog, subLblID);
 }
 
 /* expects TYPE_BOOL at the top of the stack */
 void jmpCondSub(UCompState *state, int subLblID) {
-    fprintf(state->out, ",&lbl%d JCN\n", subLblID);
+    UI_lblRef(&state->prog, ADDR_REL, subLblID);
+    emitOp(state, OP_JCN, 0);
     state->pushed -= SIZE_BOOL;
 }
 
 void jmpSub(UCompState *state, int subLblID) {
-    fprintf(state->out, ",&lbl%d JMP\n", subLblID);
+    UI_lblRef(&state->prog, ADDR_REL, subLblID);
+    emitOp(state, OP_JMP, 0);
+}
+
+/* expects TYPE_BOOL at the top of the stack, jumps if it's false */
+void jmpNotCondSub(UCompState *state, int subLblID) {
+    UI_lit(&state->prog, 0x01, 0);
+    emitOp(state, OP_NEQ, 0);
+    jmpCondSub(state, subLblID);
 }
 
 /* ==================================[[ arithmetic ]]================================== */
@@ -279,48 +478,55 @@ void pop(UCompState *state, int size) {
 
     /* use POP2 for as much as we can */
     for (i = size; i-2 >= 0; i-=2) {
-        fprintf(state->out, "POP2\n");
+        emitOp(state, OP_POP, MODE_SHORT);
     }
 
     /* we might have a left over byte that still needs to be popped */
     if (i == 1)
-        fprintf(state->out, "POP\n");
+        emitOp(state, OP_POP, 0);
     
     state->pushed-=size;
 }
 
 void dupValue(UCompState *state, UVarType type) {
     switch(type) {
-        case TYPE_INT: fprintf(state->out, "DUP2\n"); state->pushed+=SIZE_INT; break;
-        case TYPE_CHAR: case TYPE_BOOL: fprintf(state->out, "DUP\n"); state->pushed+=SIZE_CHAR; break;
+        case TYPE_INT: emitOp(state, OP_DUP, MODE_SHORT); state->pushed+=SIZE_INT; break;
+        case TYPE_CHAR: case TYPE_BOOL: emitOp(state, OP_DUP, 0); state->pushed+=SIZE_CHAR; break;
         default:
             cError(state, "Unknown variable type! [%d]", type);
     }
 }
 
-void cIntArith(UCompState *state, const char *instr) {
-    fprintf(state->out, "%s2\n", instr);
+void cIntArith(UCompState *state, UOpcode op) {
+    emitOp(state, op, MODE_SHORT);
     /* arith operations pop 2 shorts, and push 1 short, so in total we have 1 short less on the stack */
     state->pushed -= SIZE_INT;
 }
 
-void doArith(UCompState *state, const char *instr, UVarType type) {
+void cCharArith(UCompState *state, UOpcode op) {
+    /* same as ints, but a byte wide. wraps around at 256 */
+    emitOp(state, op, 0);
+    state->pushed -= SIZE_CHAR;
+}
+
+void doArith(UCompState *state, UASTNode *node, UOpcode op, UVarType type) {
     switch(type) {
-        case TYPE_INT: cIntArith(state, instr); break;
+        case TYPE_INT: cIntArith(state, op); break;
+        case TYPE_CHAR: cCharArith(state, op); break;
         default:
-            cError(state, "Unknown variable type! [%d]", type);
+            cErrorNode(state, node, "Cannot do arithmetic on type '%s'", getTypeName(type));
     }
 }
 
-void doComp(UCompState *state, const char *instr, UVarType type) {
+void doComp(UCompState *state, UOpcode op, UVarType type) {
     switch(type) {
         case TYPE_INT:
-            fprintf(state->out, "%s2\n", instr);
+            emitOp(state, op, MODE_SHORT);
             state->pushed -= SIZE_INT*2; /* pop the two shorts */
             break;
         case TYPE_CHAR: /* char and bool are the same size */
         case TYPE_BOOL:
-            fprintf(state->out, "%s\n", instr);
+            emitOp(state, op, 0);
             state->pushed -= SIZE_CHAR*2; /* pop the two bytes */
             break;
         default:
@@ -329,13 +535,91 @@ void doComp(UCompState *state, const char *instr, UVarType type) {
     state->pushed += SIZE_BOOL;
 }
 
+/* expects TYPE_BOOL at the top of the stack */
+void emitNot(UCompState *state) {
+    UI_lit(&state->prog, 0x00, 0);
+    emitOp(state, OP_EQU, 0);
+}
+
+/* ==================================[[ operand widths ]]================================== */
+
+int isLitNode(UASTNode *node) {
+    return node->type == NODE_INTLIT || node->type == NODE_CHARLIT;
+}
+
+/* int literals that fit in a byte can be written as one */
+int isByteLit(UASTNode *node) {
+    return node->type == NODE_INTLIT && (((UASTIntNode*)node)->num & 0xffff) <= 0xff;
+}
+
+UVarType operandType(UCompState *state, UASTNode *node);
+
+/* the type an expression evaluates to, without compiling it */
+UVarType staticType(UCompState *state, UASTNode *node) {
+    switch(node->type) {
+        case NODE_INTLIT: return TYPE_INT;
+        case NODE_CHARLIT: return TYPE_CHAR;
+        case NODE_BOOLLIT: return TYPE_BOOL;
+        case NODE_VAR: case NODE_ASSIGN: {
+            UASTVarNode *nVar = (UASTVarNode*)(node->type == NODE_ASSIGN ? node->left : node);
+            return getVarByID(state, nVar->scope, nVar->var)->type;
+        }
+        case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV:
+            return operandType(state, node);
+        default:
+            return TYPE_BOOL; /* comparisons */
+    }
+}
+
+/* the type both sides of a binary operator are compiled as. a byte sized int literal takes the type of a char on
+    the other side, so 'c + 1' stays a char. otherwise a char next to an int is widened like c would */
+UVarType operandType(UCompState *state, UASTNode *node) {
+    UVarType lType = staticType(state, node->left), rType = staticType(state, node->right);
+
+    if ((lType == TYPE_CHAR && isByteLit(node->right)) || (rType == TYPE_CHAR && isByteLit(node->left)))
+        return TYPE_CHAR;
+
+    if ((lType == TYPE_CHAR && rType == TYPE_INT) || (lType == TYPE_INT && rType == TYPE_CHAR))
+        return TYPE_INT;
+
+    return lType;
+}
+
+/* compiles the expression, literals are written straight at the width of `want` so they don't need a cast after */
+UVarType compileTyped(UCompState *state, UASTNode *node, UVarType want) {
+    UVarType type;
+    int num = isLitNode(node) ? ((UASTIntNode*)node)->num : 0;
+
+    if (want == TYPE_CHAR && (isByteLit(node) || node->type == NODE_CHARLIT)) {
+        writeByteLit(state, num);
+        return TYPE_CHAR;
+    } else if (want == TYPE_INT && node->type == NODE_CHARLIT) {
+        writeIntLit(state, num);
+        return TYPE_INT;
+    } else if (want == TYPE_BOOL && isLitNode(node)) {
+        writeByteLit(state, (num & 0xffff) != 0);
+        return TYPE_BOOL;
+    }
+
+    /* chars are widened implicitly, anything else is left for the caller to cast (or complain about) */
+    type = compileExpression(state, node);
+    if (type == TYPE_CHAR && want == TYPE_INT) {
+        tryTypeCast(state, TYPE_CHAR, TYPE_INT);
+        return TYPE_INT;
+    }
+
+    return type;
+}
+
+/* ==================================[[ expressions ]]================================== */
+
 UVarType compileAssignment(UCompState *state, UASTNode *node, int expectsVal) {
     UASTVarNode *nVar = (UASTVarNode*)node->left;
     UVar *rawVar = getVarByID(state, nVar->scope, nVar->var);
     UVarType expType;
 
     /* get the value of the expression */
-    expType = compileExpression(state, node->right);
+    expType = compileTyped(state, node->right, rawVar->type);
 
     /* make sure we can assign the value of this expression to this variable */
     if (!tryTypeCast(state, expType, rawVar->type))
@@ -343,41 +627,51 @@ UVarType compileAssignment(UCompState *state, UASTNode *node, int expectsVal) {
 
     /* duplicate the value on the stack if it's expected */
     if (expectsVal)
-        dupValue(state, expType);
+        dupValue(state, rawVar->type);
 
     /* assign the copy to the variable, leaving a copy on the stack for the expression */
-    setVar(state, nVar->scope, nVar->var, expType);
+    setVar(state, nVar->scope, nVar->var);
 
     return rawVar->type;
 }
 
 UVarType compileExpression(UCompState *state, UASTNode *node) {
-    UVarType lType = TYPE_NONE, rType = TYPE_NONE;
+    UVarType lType = TYPE_NONE, rType = TYPE_NONE, want;
 
     /* assignments are special, they're like statements but can be inside of expressions */
     if (node->type == NODE_ASSIGN)
         return compileAssignment(state, node, 1);
 
-    /* first, traverse down the AST recusively */
-    if (node->left)
-        lType = compileExpression(state, node->left);
-    if (node->right)
-        rType = compileExpression(state, node->right);
+    /* first, traverse down the AST recusively. a constant multiplier goes last so UI_strengthReduce() can see it */
+    if (node->left && node->right) {
+        want = operandType(state, node);
+        if (state->opts->strengthReduce && node->type == NODE_MUL && isLitNode(node->left) && !isLitNode(node->right)) {
+            rType = compileTyped(state, node->right, want);
+            lType = compileTyped(state, node->left, want);
+        } else {
+            lType = compileTyped(state, node->left, want);
+            rType = compileTyped(state, node->right, want);
+        }
+    }
 
     if (lType != TYPE_NONE && rType != TYPE_NONE && !compareVarTypes(state, lType, rType))
         cErrorNode(state, node, "lType '%s' doesn't match rType '%s'!", getTypeName(lType), getTypeName(rType));
 
     switch(node->type) {
-        case NODE_ADD: doArith(state, "ADD", lType); break;
-        case NODE_SUB: doArith(state, "SUB", lType); break;
-        case NODE_MUL: doArith(state, "MUL", lType); break;
-        case NODE_DIV: doArith(state, "DIV", lType); break;
-        case NODE_EQUAL: doComp(state, "EQU", lType); return TYPE_BOOL;
-        case NODE_NEQUAL: doComp(state, "NEQ", lType); return TYPE_BOOL;
-        case NODE_LESS: doComp(state, "LTH", lType); return TYPE_BOOL;
-        case NODE_GREATER: doComp(state, "GTH", lType); return TYPE_BOOL;
-        /* TODO: NODE_LESS_EQUAL && NODE_GREATER_EQUAL */
+        case NODE_ADD: doArith(state, node, OP_ADD, lType); break;
+        case NODE_SUB: doArith(state, node, OP_SUB, lType); break;
+        case NODE_MUL: doArith(state, node, OP_MUL, lType); break;
+        case NODE_DIV: doArith(state, node, OP_DIV, lType); break;
+        case NODE_EQUAL: doComp(state, OP_EQU, lType); return TYPE_BOOL;
+        case NODE_NEQUAL: doComp(state, OP_NEQ, lType); return TYPE_BOOL;
+        case NODE_LESS: doComp(state, OP_LTH, lType); return TYPE_BOOL;
+        case NODE_GREATER: doComp(state, OP_GTH, lType); return TYPE_BOOL;
+        /* there's no opcode for these, so they're the inverse of the strict comparison */
+        case NODE_LESS_EQUAL: doComp(state, OP_GTH, lType); emitNot(state); return TYPE_BOOL;
+        case NODE_GREATER_EQUAL: doComp(state, OP_LTH, lType); emitNot(state); return TYPE_BOOL;
         case NODE_INTLIT: writeIntLit(state, ((UASTIntNode*)node)->num); return TYPE_INT;
+        case NODE_CHARLIT: writeByteLit(state, ((UASTIntNode*)node)->num); return TYPE_CHAR;
+        case NODE_BOOLLIT: writeByteLit(state, ((UASTIntNode*)node)->num); return TYPE_BOOL;
         case NODE_VAR: return compileVar(state, node); break;
         default:
             cError(state, "unknown AST node!! [%d]\n", node->type);
@@ -400,9 +694,25 @@ void compileVoidExpression(UCompState *state, UASTNode *node) {
 }
 
 void compilePrintInt(UCompState *state, UASTNode *node) {
-    compileExpression(state, node->left);
-    fwrite(";print-decimal JSR2 #20 .Console/char DEO\n", 42, 1, state->out);
-    state->pushed -= SIZE_INT;
+    UVarType type = staticType(state, node->left);
+
+    /* chars, comparisons & int literals that fit are printed a byte wide, without widening them first */
+    if (type == TYPE_CHAR || type == TYPE_BOOL || isByteLit(node->left)) {
+        compileTyped(state, node->left, isByteLit(node->left) ? TYPE_CHAR : type);
+        callRoutine(state, RT_PRINT_BYTE);
+        state->pushed -= SIZE_CHAR;
+    } else {
+        type = compileTyped(state, node->left, TYPE_INT);
+        if (!tryTypeCast(state, type, TYPE_INT))
+            cErrorNode(state, node->left, "Cannot cast type '%s' to type '%s'", getTypeName(type), getTypeName(TYPE_INT));
+
+        callRoutine(state, RT_PRINT_DECIMAL);
+        state->pushed -= SIZE_INT;
+    }
+
+    UI_lit(&state->prog, ' ', 0);
+    emitSym(state, ADDR_ZP, "Console/char");
+    emitOp(state, OP_DEO, 0);
 }
 
 void compileDeclaration(UCompState *state, UASTNode *node) {
@@ -412,10 +722,10 @@ void compileDeclaration(UCompState *state, UASTNode *node) {
 
     /* if there's no assignment, the default value will be scary undefined memory :O */
     if (node->left) {
-        type = compileExpression(state, node->left);
-        if (!compareVarTypes(state, type, rawVar->type))
+        type = compileTyped(state, node->left, rawVar->type);
+        if (!tryTypeCast(state, type, rawVar->type))
             cErrorNode(state, node, "Cannot assign type '%s' to %.*s of type '%s'", getTypeName(type), rawVar->len, rawVar->name, getTypeName(rawVar->type));
-        setIntVar(state, var->scope, var->var);
+        setVar(state, var->scope, var->var);
     }
 }
 
@@ -429,90 +739,199 @@ void compileScope(UCompState *state, UASTNode *node) {
     popScope(state);
 }
 
+/* ==================================[[ conditions ]]================================== */
+
+int isComparison(UASTNodeType type) {
+    switch(type) {
+        case NODE_LESS: case NODE_GREATER: case NODE_EQUAL: case NODE_NEQUAL:
+        case NODE_LESS_EQUAL: case NODE_GREATER_EQUAL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* returns the comparison that's true when `type` is false */
+UASTNodeType invertComparison(UASTNodeType type) {
+    switch(type) {
+        case NODE_LESS: return NODE_GREATER_EQUAL;
+        case NODE_GREATER: return NODE_LESS_EQUAL;
+        case NODE_EQUAL: return NODE_NEQUAL;
+        case NODE_NEQUAL: return NODE_EQUAL;
+        case NODE_LESS_EQUAL: return NODE_GREATER;
+        case NODE_GREATER_EQUAL: return NODE_LESS;
+        default: return type;
+    }
+}
+
+/* if the node is a literal that can be moved one step away from `limit` without wrapping */
+int isAdjustableLit(UASTNode *node, uint16_t limit) {
+    return isLitNode(node) && (((UASTIntNode*)node)->num & 0xffff) != limit;
+}
+
+/* writes the literal + adjust at the width of type */
+UVarType writeAdjustedLit(UCompState *state, UASTNode *node, int adjust, UVarType type) {
+    int num = ((UASTIntNode*)node)->num + adjust;
+
+    if (type == TYPE_CHAR) {
+        writeByteLit(state, num);
+        return TYPE_CHAR;
+    }
+
+    writeIntLit(state, num);
+    return TYPE_INT;
+}
+
+/* compiles both sides of a comparison, literals are written as their value + lAdjust/rAdjust */
+UVarType compileOperands(UCompState *state, UASTNode *node, int lAdjust, int rAdjust) {
+    UVarType lType, rType, want = operandType(state, node);
+
+    if (lAdjust)
+        lType = writeAdjustedLit(state, node->left, lAdjust, want);
+    else
+        lType = compileTyped(state, node->left, want);
+
+    if (rAdjust)
+        rType = writeAdjustedLit(state, node->right, rAdjust, want);
+    else
+        rType = compileTyped(state, node->right, want);
+
+    if (!compareVarTypes(state, lType, rType))
+        cErrorNode(state, node, "lType '%s' doesn't match rType '%s'!", getTypeName(lType), getTypeName(rType));
+
+    return lType;
+}
+
+/* jumps to subLblID if the condition is equal to jmpIf, without building a bool first. comparisons branch on the
+    opcode directly (inverted when jumping on false), and <=/>= against an int literal become the strict comparison
+    against the literal +/- 1 */
+void compileBranch(UCompState *state, UASTNode *cond, int subLblID, int jmpIf) {
+    UASTNodeType type = cond->type;
+    uint16_t max;
+    UVarType vType;
+    int adjust;
+
+    /* constant conditions (from the folder) either always jump or never do */
+    if (type == NODE_BOOLLIT) {
+        if (((UASTIntNode*)cond)->num == jmpIf)
+            jmpSub(state, subLblID);
+        return;
+    }
+
+    if (!isComparison(type)) {
+        vType = compileExpression(state, cond);
+        switch(vType) {
+            case TYPE_INT: /* JCN only looks at a byte, so fold the short into one that's non-zero if any bit is set */
+                emitOp(state, OP_ORA, 0);
+                state->pushed -= 1;
+                break;
+            case TYPE_CHAR: case TYPE_BOOL: break;
+            default:
+                cErrorNode(state, cond, "Cannot cast type '%s' to type '%s'", getTypeName(vType), getTypeName(TYPE_BOOL));
+        }
+
+        if (!jmpIf)
+            emitNot(state);
+        jmpCondSub(state, subLblID);
+        return;
+    }
+
+    if (!jmpIf)
+        type = invertComparison(type);
+
+    /* the literal can't be adjusted past the largest value of the comparison's width. literals compared against a
+        bool are written as 0 or 1, so those are never adjusted */
+    vType = operandType(state, cond);
+    max = vType == TYPE_CHAR ? 0xff : 0xffff;
+    adjust = vType != TYPE_BOOL;
+
+    switch(type) {
+        case NODE_EQUAL: doComp(state, OP_EQU, compileOperands(state, cond, 0, 0)); break;
+        case NODE_NEQUAL: doComp(state, OP_NEQ, compileOperands(state, cond, 0, 0)); break;
+        case NODE_LESS: doComp(state, OP_LTH, compileOperands(state, cond, 0, 0)); break;
+        case NODE_GREATER: doComp(state, OP_GTH, compileOperands(state, cond, 0, 0)); break;
+        case NODE_LESS_EQUAL: /* a <= b is a < b + 1, or a - 1 < b */
+            if (adjust && isAdjustableLit(cond->right, max))
+                doComp(state, OP_LTH, compileOperands(state, cond, 0, 1));
+            else if (adjust && isAdjustableLit(cond->left, 0x0000))
+                doComp(state, OP_LTH, compileOperands(state, cond, -1, 0));
+            else {
+                doComp(state, OP_GTH, compileOperands(state, cond, 0, 0));
+                emitNot(state);
+            }
+            break;
+        case NODE_GREATER_EQUAL: /* a >= b is a > b - 1, or a + 1 > b */
+            if (adjust && isAdjustableLit(cond->right, 0x0000))
+                doComp(state, OP_GTH, compileOperands(state, cond, 0, -1));
+            else if (adjust && isAdjustableLit(cond->left, max))
+                doComp(state, OP_GTH, compileOperands(state, cond, 1, 0));
+            else {
+                doComp(state, OP_LTH, compileOperands(state, cond, 0, 0));
+                emitNot(state);
+            }
+            break;
+        default: break;
+    }
+
+    jmpCondSub(state, subLblID);
+}
+
 void compileIf(UCompState *state, UASTNode *node) {
     UASTIfNode *ifNode = (UASTIfNode*)node;
     int jmpID = newLbl(state);
 
-    /* compile conditional */
-    UVarType type = compileExpression(state, node->left);
-
-    if (!tryTypeCast(state, type, TYPE_BOOL))
-        cErrorNode(state, (UASTNode*)node->left, "Cannot cast type '%s' to type '%s'", getTypeName(type), getTypeName(TYPE_BOOL));
-
     if (ifNode->elseBlock) {
         int tmpJmp = jmpID;
-        /* write comparison jump, if the flag is equal to true, jump to the true block */
-        jmpCondSub(state, tmpJmp);
+        /* if the condition is true, jump to the true block */
+        compileBranch(state, node->left, tmpJmp, 1);
         compileAST(state, ifNode->elseBlock);
         jmpSub(state, jmpID = newLbl(state)); /* skip the true block */
         /* true block */
         defineSubLbl(state, tmpJmp);
         compileAST(state, ifNode->block);
     } else {
-        /* write comparison jump, if the flag is not equal to true, skip the true block */
-        fprintf(state->out, "#01 NEQ ");
-        jmpCondSub(state, jmpID);
+        /* if the condition is false, skip the true block */
+        compileBranch(state, node->left, jmpID, 0);
         compileAST(state, ifNode->block);
     }
 
     defineSubLbl(state, jmpID);
 }
 
+/* loops are laid out with the condition at the bottom, so each iteration only runs the condition & one JCN */
 void compileWhile(UCompState *state, UASTNode *node) {
     UASTWhileNode *whileNode = (UASTWhileNode*)node;
-    int loopStart = newLbl(state);
-    int loopExit = newLbl(state);
-
-    /* compile conditional */
-    defineSubLbl(state, loopStart);
-    UVarType type = compileExpression(state, node->left);
+    int loopBody = newLbl(state);
+    int loopCond = newLbl(state);
 
-    if (!tryTypeCast(state, type, TYPE_BOOL))
-        cErrorNode(state, node, "Cannot cast type '%s' to type '%s'", getTypeName(type), getTypeName(TYPE_BOOL));
-
-    /* write comparison jump, if the flag is not equal to true, exit the loop */
-    fprintf(state->out, "#01 NEQ ");
-    jmpCondSub(state, loopExit);
+    /* on entry, we jump straight to the conditional */
+    jmpSub(state, loopCond);
 
+    defineSubLbl(state, loopBody);
     compileAST(state, whileNode->block);
 
-    /* jump back to the start of the loop */
-    jmpSub(state, loopStart);
-    defineSubLbl(state, loopExit);
+    /* if the condition is true, jump back to the start of the loop */
+    defineSubLbl(state, loopCond);
+    compileBranch(state, node->left, loopBody, 1);
 }
 
 void compileFor(UCompState *state, UASTNode *node) {
-    UVarType type;
     UASTForNode *forNode = (UASTForNode*)node;
-    int loopEntry = newLbl(state);
-    int loopStart = newLbl(state);
-    int loopExit = newLbl(state);
+    int loopBody = newLbl(state);
+    int loopCond = newLbl(state);
 
     /* compile initalizer */
     compileVoidExpression(state, node->left);
-    jmpSub(state, loopEntry); /* on entry, we skip the iterator */
-
-    /* compile iterator */
-    defineSubLbl(state, loopStart);
-    compileVoidExpression(state, forNode->iter);
-
-    /* compile conditional */
-    defineSubLbl(state, loopEntry);
-    type = compileExpression(state, forNode->cond);
+    jmpSub(state, loopCond); /* on entry, we skip the block & iterator */
 
-    if (!tryTypeCast(state, type, TYPE_BOOL))
-        cErrorNode(state, node, "Cannot cast type '%s' to type '%s'", getTypeName(type), getTypeName(TYPE_BOOL));
-
-    /* write comparison jump, if the flag is not equal to true, exit the loop */
-    fprintf(state->out, "#01 NEQ ");
-    jmpCondSub(state, loopExit);
-
-    /* finally, compile loop block */
+    /* compile loop block, then the iterator */
+    defineSubLbl(state, loopBody);
     compileAST(state, forNode->block);
+    compileVoidExpression(state, forNode->iter);
 
-    /* jump back to the start of the loop */
-    jmpSub(state, loopStart);
-    defineSubLbl(state, loopExit);
+    /* if the condition is true, jump back to the start of the loop */
+    defineSubLbl(state, loopCond);
+    compileBranch(state, forNode->cond, loopBody, 1);
 }
 
 void compileAST(UCompState *state, UASTNode *node) {
@@ -535,21 +954,115 @@ void compileAST(UCompState *state, UASTNode *node) {
     }
 }
 
-void UA_genTal(UASTRootNode *tree, FILE *out) {
+/* writes every routine the program called & the routines those call, in a fixed order so the output is stable */
+void writeRoutines(UCompState *state) {
+    unsigned int used = state->routines, last;
+    int i;
+
+    do {
+        last = used;
+        for (i = 0; i < RT_MAX; i++) {
+            if (used & ROUTINE_BIT(i))
+                used |= routines[i].deps;
+        }
+    } while (used != last);
+
+    for (i = 0; i < RT_MAX; i++) {
+        if (!(used & ROUTINE_BIT(i)))
+            continue;
+
+        UA_putc(state->out, '@');
+        UA_puts(state->out, routines[i].name);
+        UA_putc(state->out, '\n');
+        UA_puts(state->out, routines[i].body);
+    }
+}
+
+/* declares the zero-page slots of promoted vars */
+void writeZeroPage(UCompState *state, UASTRootNode *tree) {
+    int i;
+
+    if (tree->zpCount == 0)
+        return;
+
+    UA_puts(state->out, "@uxncle-zp [");
+    for (i = 0; i < tree->zpCount; i++) {
+        UA_puts(state->out, " &v");
+        UA_dec(state->out, i);
+        UA_puts(state->out, " $");
+        UA_hex(state->out, getSize(state, tree->zpVars[i]->type));
+    }
+    UA_puts(state->out, " ]\n");
+}
+
+/* labels every used offset of the static frame, vars in sibling scopes can share an offset */
+void writeStaticFrame(UCompState *state, UASTRootNode *tree) {
+    int i, last = 0;
+
+    UA_puts(state->out, "@uxncle-heap\n");
+    for (i = 0; i < tree->frameSize; i++) {
+        if (!state->frameLbls[i])
+            continue;
+
+        if (i > last) {
+            UA_putc(state->out, '$');
+            UA_hex(state->out, i - last);
+            UA_putc(state->out, ' ');
+        }
+        UA_puts(state->out, "&f");
+        UA_hex(state->out, i);
+        UA_putc(state->out, '\n');
+        last = i;
+    }
+    UA_puts(state->out, "|ffff &end");
+}
+
+void UA_genTal(UASTRootNode *tree, UOutBuf *out, UOptions *opts, UError *err) {
     UCompState state;
+    UI_initProgram(&state.prog);
+    state.scopes = NULL;
     state.sCount = 0;
+    state.sCap = 8;
+    state.frameTop = 0;
     state.pushed = 0;
-    state.jmpID = 0;
     state.out = out;
+    state.opts = opts;
+    state.err = err;
+    state.frameLbls = NULL;
+    state.routines = 0;
+
+    if (opts->staticFrame) {
+        state.frameLbls = (uint8_t*)UM_realloc(NULL, tree->frameSize + 1);
+        memset(state.frameLbls, 0, tree->frameSize + 1);
+    }
 
     /* first, write the preamble */
-    fwrite(preamble, sizeof(preamble)-1, 1, out);
+    UA_write(out, preamble, sizeof(preamble)-1);
+    writeZeroPage(&state, tree);
+    UA_write(out, prgPreamble, sizeof(prgPreamble)-1);
+    if (!opts->staticFrame)
+        UA_write(out, heapPreamble, sizeof(heapPreamble)-1);
 
-    /* now parse the whole AST */
+    /* now lower the whole AST */
     pushScope(&state, &tree->scope);
     compileAST(&state, tree->_node.left);
     popScope(&state);
 
+    UI_buildBlocks(&state.prog);
+    if (opts->strengthReduce)
+        UI_strengthReduce(&state.prog);
+    if (opts->peephole)
+        UI_peephole(&state.prog);
+    UI_relaxBranches(&state.prog);
+    UI_print(&state.prog, out);
+
     /* finally, write the postamble */
-    fwrite(postamble, sizeof(postamble)-1, 1, out);
+    UA_write(out, postamble, sizeof(postamble)-1);
+    writeRoutines(&state);
+    if (opts->staticFrame)
+        writeStaticFrame(&state, tree);
+    else
+        UA_write(out, heapPostamble, sizeof(heapPostamble)-1);
+
+    freeCompState(&state);
 }
\ No newline at end of file
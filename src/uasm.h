@@ -3,17 +3,49 @@
 
 #include "uxncle.h"
 #include "uparse.h"
+#include "uerror.h"
 
 /* default heap space to hold temporary values */
 #define HEAP_SPACE 0x1800
 
+/* zero-page bytes left after the @uxncle block in the preamble */
+#define ZERO_PAGE_SPACE 0xfe
+
 #define SIZE_INT    2
 #define SIZE_CHAR   1
 #define SIZE_BOOL   1
 
-#include <stdio.h>
+/* ==================================[[ output buffer ]]================================== */
+
+/* generated text is collected here and written out with a single write() */
+typedef struct {
+    char *buf; /* always null terminated */
+    size_t len;
+    size_t cap;
+    int fd; /* UA_flush() writes to this, -1 if the text only lives in memory */
+} UOutBuf;
+
+/* pass -1 as the fd to keep the text in memory, read it from out->buf & out->len */
+void UA_initBuffer(UOutBuf *out, int fd);
+void UA_freeBuffer(UOutBuf *out);
+
+void UA_write(UOutBuf *out, const char *str, size_t len);
+void UA_puts(UOutBuf *out, const char *str);
+void UA_putc(UOutBuf *out, char c);
+
+/* number formatting, hex is lowercase like the rest of the generated uxntal */
+void UA_hex8(UOutBuf *out, int val); /* always 2 digits */
+void UA_hex16(UOutBuf *out, int val); /* always 4 digits */
+void UA_hex(UOutBuf *out, unsigned int val); /* no leading zeros */
+void UA_dec(UOutBuf *out, unsigned int val);
+
+/* writes everything to the fd & empties the buffer, returns 0 if the write failed. memory buffers are left alone */
+int UA_flush(UOutBuf *out);
+
+/* ==================================[[ code generation ]]================================== */
 
-/* takes a syntax tree and spits out the generated asm into the provided file stream */
-void UA_genTal(UASTRootNode *tree, FILE *out);
+/* takes a resolved syntax tree (see US_resolve()) and appends the generated asm to the buffer, errors are raised
+    through err */
+void UA_genTal(UASTRootNode *tree, UOutBuf *out, UOptions *opts, UError *err);
 
 #endif
\ No newline at end of file
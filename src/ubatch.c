@@ -0,0 +1,157 @@
+#include "ubatch.h"
+#include "ucompiler.h"
+
+#include <pthread.h>
+
+/* a worker's share of the jobs. the owner takes jobs from the tail, thieves take them from the head */
+typedef struct {
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} UDeque;
+
+typedef struct {
+    UBatchJob *jobs;
+    UDeque *deques; /* one per worker, deque i holds job indices i*count/threads up to (i+1)*count/threads */
+    int threads;
+    UOptions *opts;
+    int emitRom;
+    UCache *cache; /* shared by every worker */
+} UBatch;
+
+typedef struct {
+    UBatch *batch;
+    int id;
+    pthread_t thread;
+} UWorker;
+
+/* returns -1 if the deque is empty */
+int popJob(UDeque *deque, int fromHead) {
+    int job = -1;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail)
+        job = fromHead ? deque->head++ : --deque->tail;
+    pthread_mutex_unlock(&deque->lock);
+
+    return job;
+}
+
+/* takes our own next job, or steals one from the next busy worker. jobs are never added once the batch started, so
+    once every deque is empty we're done */
+int nextJob(UBatch *batch, int id) {
+    int i, job;
+
+    if ((job = popJob(&batch->deques[id], 0)) != -1)
+        return job;
+
+    for (i = 1; i < batch->threads; i++) {
+        if ((job = popJob(&batch->deques[(id + i) % batch->threads], 1)) != -1)
+            return job;
+    }
+
+    return -1;
+}
+
+int writeOutput(const char *path, const void *data, size_t len) {
+    FILE *out = fopen(path, "wb");
+    int ok;
+
+    if (out == NULL)
+        return 0;
+
+    ok = fwrite(data, 1, len, out) == len;
+    return fclose(out) == 0 && ok;
+}
+
+void runJob(UCompiler *comp, UBatchJob *job, int emitRom) {
+    const char *tal;
+    const uint8_t *rom;
+    const void *data;
+    size_t len;
+
+    if (emitRom) {
+        job->ok = UC_compileRom(comp, job->src, &rom, &len);
+        data = rom;
+    } else {
+        job->ok = UC_compileTal(comp, job->src, &tal, &len);
+        data = tal;
+    }
+
+    if (!job->ok) {
+        sprintf(job->msg, "%.48s: %s", job->name, comp->err.msg);
+        return;
+    }
+
+    if (!(job->ok = writeOutput(job->outPath, data, len)))
+        sprintf(job->msg, "%.48s: Could not write \"%.*s\".", job->name, UERROR_MSG_SIZE - 32, job->outPath);
+}
+
+void *workerMain(void *arg) {
+    UWorker *worker = (UWorker*)arg;
+    UBatch *batch = worker->batch;
+    UCompiler comp;
+    int job;
+
+    UC_initCompiler(&comp, batch->opts);
+    comp.cache = batch->cache;
+    while ((job = nextJob(batch, worker->id)) != -1)
+        runJob(&comp, &batch->jobs[job], batch->emitRom);
+    UC_freeCompiler(&comp);
+
+    return NULL;
+}
+
+int UB_compileBatch(UBatchJob *jobs, int count, int threads, UOptions *opts, int emitRom, UCache *cache) {
+    UBatch batch;
+    UWorker *workers;
+    int i, failed = 0;
+
+    if (threads > count)
+        threads = count;
+    if (threads < 1)
+        threads = 1;
+
+    for (i = 0; i < count; i++) {
+        jobs[i].ok = 0;
+        jobs[i].msg[0] = '\0';
+    }
+
+    batch.jobs = jobs;
+    batch.threads = threads;
+    batch.opts = opts;
+    batch.emitRom = emitRom;
+    batch.cache = cache;
+    batch.deques = (UDeque*)UM_realloc(NULL, sizeof(UDeque) * threads);
+    workers = (UWorker*)UM_realloc(NULL, sizeof(UWorker) * threads);
+
+    for (i = 0; i < threads; i++) {
+        pthread_mutex_init(&batch.deques[i].lock, NULL);
+        batch.deques[i].head = (int)((long)i * count / threads);
+        batch.deques[i].tail = (int)((long)(i + 1) * count / threads);
+        workers[i].batch = &batch;
+        workers[i].id = i;
+    }
+
+    /* the calling thread is worker 0, if a thread can't be started its jobs just get stolen */
+    for (i = 1; i < threads; i++) {
+        if (pthread_create(&workers[i].thread, NULL, workerMain, &workers[i]) != 0)
+            workers[i].id = -1;
+    }
+    workerMain(&workers[0]);
+
+    for (i = 1; i < threads; i++) {
+        if (workers[i].id != -1)
+            pthread_join(workers[i].thread, NULL);
+    }
+
+    for (i = 0; i < threads; i++)
+        pthread_mutex_destroy(&batch.deques[i].lock);
+    UM_free(batch.deques);
+    UM_free(workers);
+
+    for (i = 0; i < count; i++)
+        failed += !jobs[i].ok;
+
+    return failed;
+}
@@ -0,0 +1,24 @@
+#ifndef UBATCH_H
+#define UBATCH_H
+
+#include "uxncle.h"
+#include "uerror.h"
+#include "ucache.h"
+
+/* one source file of a batch */
+typedef struct {
+    const char *name; /* shown in front of the diagnostic */
+    const char *src; /* null terminated source */
+    const char *outPath; /* the uxntal (or rom) is written here */
+    /* set by UB_compileBatch() */
+    int ok;
+    char msg[UERROR_MSG_SIZE + 64]; /* the diagnostic if the compile or the write failed */
+} UBatchJob;
+
+/* compiles every job on a pool of worker threads, each worker keeps one UCompiler (and its scratch memory) for all
+    of its jobs. jobs are handed out up front and idle workers steal from the busy ones, but every job's output &
+    diagnostic only depend on its own source so the results are the same however the jobs got scheduled. cache can be
+    NULL. returns the number of jobs that failed */
+int UB_compileBatch(UBatchJob *jobs, int count, int threads, UOptions *opts, int emitRom, UCache *cache);
+
+#endif
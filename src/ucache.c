@@ -0,0 +1,301 @@
+/* mkstemp(), utime() & friends aren't part of strict c89 */
+#define _DEFAULT_SOURCE
+
+#include "ucache.h"
+#include "umem.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#define KEY_DIGITS 16
+#define ENTRY_NAME_LEN (KEY_DIGITS + 4) /* "<key>.tal" */
+
+/* evicting goes a bit below the limit so the next few stores don't have to scan the directory again */
+#define EVICT_TARGET(max) ((max) / 4 * 3)
+
+typedef struct {
+    char name[ENTRY_NAME_LEN + 1];
+    time_t used; /* mtime, bumped on every hit */
+    size_t size;
+} UCacheEntry;
+
+/* ==================================[[ hashing ]]================================== */
+
+#define HASH_SEED 0x9e3779b97f4a7c15ULL
+#define HASH_MUL1 0xbf58476d1ce4e5b9ULL
+#define HASH_MUL2 0x94d049bb133111ebULL
+
+uint64_t mixKey(uint64_t hash, uint64_t word) {
+    hash ^= word * HASH_MUL1;
+    hash = (hash << 31) | (hash >> 33);
+    return hash * HASH_MUL2;
+}
+
+/* eats 8 bytes at a time, the tail is zero padded */
+uint64_t hashBytes(uint64_t hash, const char *data, size_t len) {
+    uint64_t word;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&word, data + i, 8);
+        hash = mixKey(hash, word);
+    }
+
+    if (i < len) {
+        word = 0;
+        memcpy(&word, data + i, len - i);
+        hash = mixKey(hash, word);
+    }
+
+    return mixKey(hash, len);
+}
+
+uint64_t UK_key(const char *src, size_t len, UOptions *opts, int rom) {
+    char config[64];
+    uint64_t hash;
+
+    sprintf(config, "uxncle %s %d%d%d%d%d%d %s", UXNCLE_VERSION, opts->foldConstants, opts->zeroPage, opts->peephole,
+        opts->staticFrame, opts->strengthReduce, opts->deadCode, rom ? "rom" : "tal");
+
+    hash = hashBytes(HASH_SEED, config, strlen(config));
+    hash = hashBytes(hash, src, len);
+
+    /* final avalanche, so every bit of the key depends on every input bit */
+    hash ^= hash >> 33;
+    hash *= HASH_MUL1;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+/* ==================================[[ entries ]]================================== */
+
+/* returns a malloc'd "<dir>/<key>.tal" (or .rom) */
+char *entryPath(UCache *cache, uint64_t key, int rom) {
+    char *path = (char*)UM_realloc(NULL, strlen(cache->dir) + ENTRY_NAME_LEN + 2);
+
+    sprintf(path, "%s/%08lx%08lx%s", cache->dir, (unsigned long)(key >> 32), (unsigned long)(key & 0xffffffff),
+        rom ? ".rom" : ".tal");
+    return path;
+}
+
+/* only "<16 hex digits>.tal" & ".rom" files are ours, anything else in the directory is left alone */
+int isEntryName(const char *name) {
+    int i;
+
+    if (strlen(name) != ENTRY_NAME_LEN)
+        return 0;
+
+    for (i = 0; i < KEY_DIGITS; i++) {
+        if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f')))
+            return 0;
+    }
+
+    return strcmp(name + KEY_DIGITS, ".tal") == 0 || strcmp(name + KEY_DIGITS, ".rom") == 0;
+}
+
+/* lists every entry in the directory, sets *total to their combined size. returns the count, or -1 if the directory
+    couldn't be read */
+int scanEntries(UCache *cache, UCacheEntry **entries, size_t *total) {
+    DIR *dir = opendir(cache->dir);
+    struct dirent *ent;
+    struct stat info;
+    char *path = (char*)UM_realloc(NULL, strlen(cache->dir) + ENTRY_NAME_LEN + 2);
+    int count = 0, cap = 0;
+
+    *entries = NULL;
+    *total = 0;
+    if (dir == NULL) {
+        UM_free(path);
+        return -1;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (!isEntryName(ent->d_name))
+            continue;
+
+        /* it might've been evicted by someone else since readdir() saw it */
+        sprintf(path, "%s/%s", cache->dir, ent->d_name);
+        if (stat(path, &info) != 0)
+            continue;
+
+        if (count >= cap) {
+            cap = cap ? cap * GROW_FACTOR : 64;
+            *entries = (UCacheEntry*)UM_realloc(*entries, sizeof(UCacheEntry) * cap);
+        }
+
+        strcpy((*entries)[count].name, ent->d_name);
+        (*entries)[count].used = info.st_mtime;
+        (*entries)[count].size = info.st_size;
+        *total += info.st_size;
+        count++;
+    }
+
+    closedir(dir);
+    UM_free(path);
+    return count;
+}
+
+/* oldest first, the name breaks ties so every process evicts in the same order */
+int compareEntries(const void *a, const void *b) {
+    const UCacheEntry *e1 = (const UCacheEntry*)a, *e2 = (const UCacheEntry*)b;
+
+    if (e1->used != e2->used)
+        return e1->used < e2->used ? -1 : 1;
+
+    return strcmp(e1->name, e2->name);
+}
+
+/* recounts the directory & deletes the least recently used entries if it's over the limit, call with the lock held */
+void evictEntries(UCache *cache) {
+    UCacheEntry *entries;
+    char *path;
+    size_t total;
+    int count, i;
+
+    if ((count = scanEntries(cache, &entries, &total)) == -1)
+        return;
+
+    if (total > cache->maxSize) {
+        path = (char*)UM_realloc(NULL, strlen(cache->dir) + ENTRY_NAME_LEN + 2);
+        qsort(entries, count, sizeof(UCacheEntry), compareEntries);
+
+        for (i = 0; i < count && total > EVICT_TARGET(cache->maxSize); i++) {
+            sprintf(path, "%s/%s", cache->dir, entries[i].name);
+            if (unlink(path) == 0 || errno == ENOENT) {
+                total -= entries[i].size;
+                cache->evictions++;
+            }
+        }
+
+        UM_free(path);
+    }
+
+    cache->size = total;
+    UM_free(entries);
+}
+
+/* ==================================[[ cache ]]================================== */
+
+int UK_openCache(UCache *cache, const char *dir, size_t maxSize) {
+    struct stat info;
+    size_t len = strlen(dir);
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return 0;
+    if (stat(dir, &info) != 0 || !S_ISDIR(info.st_mode))
+        return 0;
+
+    /* "cache/" -> "cache" */
+    while (len > 1 && dir[len - 1] == '/')
+        len--;
+
+    cache->dir = (char*)UM_realloc(NULL, len + 1);
+    memcpy(cache->dir, dir, len);
+    cache->dir[len] = '\0';
+    cache->maxSize = maxSize;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->stores = 0;
+    cache->evictions = 0;
+    pthread_mutex_init(&cache->lock, NULL);
+
+    /* the limit might've been lowered since the last run */
+    evictEntries(cache);
+    return 1;
+}
+
+void UK_closeCache(UCache *cache) {
+    pthread_mutex_destroy(&cache->lock);
+    UM_free(cache->dir);
+}
+
+int UK_load(UCache *cache, uint64_t key, int rom, UOutBuf *out) {
+    char *path = entryPath(cache, key, rom);
+    char buf[4096];
+    size_t read;
+    FILE *file;
+    int hit = 0;
+
+    /* entries are renamed into place whole, so if it opens it's complete */
+    if ((file = fopen(path, "rb")) != NULL) {
+        while ((read = fread(buf, 1, sizeof(buf), file)) > 0)
+            UA_write(out, buf, read);
+
+        hit = !ferror(file);
+        fclose(file);
+
+        /* bump the mtime, eviction goes by least recently used */
+        if (hit)
+            utime(path, NULL);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    if (hit)
+        cache->hits++;
+    else
+        cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    UM_free(path);
+    return hit;
+}
+
+void UK_store(UCache *cache, uint64_t key, int rom, const void *data, size_t len) {
+    char *path = entryPath(cache, key, rom);
+    char *tmp = (char*)UM_realloc(NULL, strlen(cache->dir) + 16);
+    FILE *file = NULL;
+    int fd, ok;
+
+    /* write it next to the entry & rename it into place, a crash or a concurrent reader never sees a partial entry */
+    sprintf(tmp, "%s/tmp-XXXXXX", cache->dir);
+    if ((fd = mkstemp(tmp)) == -1 || (file = fdopen(fd, "wb")) == NULL) {
+        if (fd != -1) {
+            close(fd);
+            unlink(tmp);
+        }
+        UM_free(tmp);
+        UM_free(path);
+        return;
+    }
+
+    ok = fwrite(data, 1, len, file) == len;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        UM_free(tmp);
+        UM_free(path);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stores++;
+    cache->size += len;
+    if (cache->size > cache->maxSize)
+        evictEntries(cache);
+    pthread_mutex_unlock(&cache->lock);
+
+    UM_free(tmp);
+    UM_free(path);
+}
+
+void UK_printStats(UCache *cache, FILE *out) {
+    UCacheEntry *entries;
+    unsigned long lookups;
+    size_t total;
+    int count;
+
+    pthread_mutex_lock(&cache->lock);
+    lookups = cache->hits + cache->misses;
+    fprintf(out, "cache: %lu hits, %lu misses (%.1f%% hit rate), %lu stores, %lu evictions\n", cache->hits,
+        cache->misses, lookups ? 100.0 * cache->hits / lookups : 0.0, cache->stores, cache->evictions);
+
+    count = scanEntries(cache, &entries, &total);
+    fprintf(out, "cache: %d entries, %lu of %lu bytes used in %s\n", count < 0 ? 0 : count, (unsigned long)total,
+        (unsigned long)cache->maxSize, cache->dir);
+    pthread_mutex_unlock(&cache->lock);
+
+    UM_free(entries);
+}
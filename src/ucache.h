@@ -0,0 +1,43 @@
+#ifndef UCACHE_H
+#define UCACHE_H
+
+#include "uxncle.h"
+#include "uasm.h"
+
+#include <pthread.h>
+
+/* default size limit of the cache directory */
+#define CACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+
+/* content addressed cache of compiled outputs in a local directory. entries are named after the key, written to a
+    temp file & renamed into place so readers never see half an entry, and the least recently used ones are deleted
+    once the directory grows past maxSize. one UCache can be shared between threads */
+typedef struct {
+    char *dir;
+    size_t maxSize;
+    pthread_mutex_t lock; /* guards everything below */
+    size_t size; /* bytes of entries, counted when the cache is opened & kept up to date from there */
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long stores;
+    unsigned long evictions;
+} UCache;
+
+/* creates the directory if it doesn't exist yet, returns 0 if it couldn't be created */
+int UK_openCache(UCache *cache, const char *dir, size_t maxSize);
+void UK_closeCache(UCache *cache);
+
+/* hashes the source with everything else that changes the output: the compiler version, the optimizations & whether
+    it's uxntal or a rom */
+uint64_t UK_key(const char *src, size_t len, UOptions *opts, int rom);
+
+/* appends the cached output to the buffer, returns 0 on a miss */
+int UK_load(UCache *cache, uint64_t key, int rom, UOutBuf *out);
+
+/* failing to store an entry isn't an error, the next compile just misses again */
+void UK_store(UCache *cache, uint64_t key, int rom, const void *data, size_t len);
+
+/* prints the hit/miss counters & what's currently in the directory */
+void UK_printStats(UCache *cache, FILE *out);
+
+#endif
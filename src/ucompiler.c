@@ -0,0 +1,191 @@
+#include "ucompiler.h"
+#include "uopt.h"
+#include "usema.h"
+
+void UC_initCompiler(UCompiler *comp, UOptions *opts) {
+    if (opts)
+        comp->opts = *opts;
+    else
+        memset(&comp->opts, 0, sizeof(UOptions));
+
+    UE_initError(&comp->err);
+    UM_initArena(&comp->arena, 0);
+    comp->treeSize = 0;
+    UA_initBuffer(&comp->tal, -1);
+    comp->rom = NULL;
+    comp->cache = NULL;
+}
+
+void UC_freeCompiler(UCompiler *comp) {
+    UM_freeArena(&comp->arena);
+    UA_freeBuffer(&comp->tal);
+    if (comp->rom) {
+        UR_freeRom(comp->rom);
+        UM_free(comp->rom);
+    }
+}
+
+void resetTal(UCompiler *comp) {
+    comp->tal.len = 0;
+    comp->tal.buf[0] = '\0';
+}
+
+/* gives comp->rom a freshly initialized rom, the struct itself is only allocated once */
+URom *resetRom(UCompiler *comp) {
+    if (comp->rom == NULL)
+        comp->rom = (URom*)UM_realloc(NULL, sizeof(URom));
+    else
+        UR_freeRom(comp->rom);
+
+    UR_initRom(comp->rom);
+    return comp->rom;
+}
+
+/* runs the whole pipeline into comp->tal, returns 0 if an error was raised */
+int compileSource(UCompiler *comp, const char *src) {
+    UASTRootNode *volatile tree = NULL;
+    jmp_buf jmp;
+
+    resetTal(comp);
+    comp->err.msg[0] = '\0';
+
+    /* every stage frees its own scratch before raising, only the tree is left for us */
+    comp->err.jmp = &jmp;
+    if (setjmp(jmp)) {
+        comp->err.jmp = NULL;
+        if (tree)
+            UP_freeTree(tree);
+        return 0;
+    }
+
+    tree = UP_parseSource(src, &comp->arena, &comp->err);
+    US_checkTypes(tree, &comp->err);
+    if (comp->opts.foldConstants)
+        UO_foldConstants(tree);
+    if (comp->opts.deadCode)
+        UO_eliminateDeadCode(tree);
+    US_resolve(tree, &comp->opts, &comp->err);
+    UA_genTal(tree, &comp->tal, &comp->opts, &comp->err);
+
+    comp->err.jmp = NULL;
+    comp->treeSize = comp->arena.used;
+    UP_freeTree(tree);
+    return 1;
+}
+
+int UC_compileTal(UCompiler *comp, const char *src, const char **tal, size_t *len) {
+    uint64_t key = 0;
+
+    if (comp->cache) {
+        key = UK_key(src, strlen(src), &comp->opts, 0);
+        resetTal(comp);
+    }
+
+    if (comp->cache == NULL || !UK_load(comp->cache, key, 0, &comp->tal)) {
+        if (!compileSource(comp, src))
+            return 0;
+
+        if (comp->cache)
+            UK_store(comp->cache, key, 0, comp->tal.buf, comp->tal.len);
+    }
+
+    *tal = comp->tal.buf;
+    *len = comp->tal.len;
+    return 1;
+}
+
+/* cached roms are the rom's size (2 bytes, big endian) & bytes, followed by every label as its address (2 bytes, big
+    endian) & null terminated name like uxnasm's .sym files. the labels are kept so a rom from the cache can be used
+    the same way as a freshly assembled one, eg. the vm looks up uxncle/heap */
+void storeCachedRom(UCompiler *comp, uint64_t key) {
+    URom *rom = comp->rom;
+    int size = UR_romSize(rom), i;
+    UOutBuf entry;
+
+    UA_initBuffer(&entry, -1);
+    UA_putc(&entry, size >> 8);
+    UA_putc(&entry, size & 0xff);
+    UA_write(&entry, (const char*)rom->data + ROM_START, size);
+
+    for (i = 0; i < rom->names.sCount; i++) {
+        if (!rom->labels[i].defined)
+            continue;
+
+        UA_putc(&entry, rom->labels[i].addr >> 8);
+        UA_putc(&entry, rom->labels[i].addr & 0xff);
+        UA_write(&entry, rom->names.syms[i].str, rom->names.syms[i].len);
+        UA_putc(&entry, '\0');
+    }
+
+    UK_store(comp->cache, key, 1, entry.buf, entry.len);
+    UA_freeBuffer(&entry);
+}
+
+/* a cached rom is loaded into comp->tal first, returns 0 on a miss or if the entry is cut short */
+int loadCachedRom(UCompiler *comp, uint64_t key) {
+    const uint8_t *entry;
+    size_t len, size, pos, end;
+    URom *rom;
+
+    resetTal(comp);
+    if (!UK_load(comp->cache, key, 1, &comp->tal))
+        return 0;
+
+    entry = (const uint8_t*)comp->tal.buf;
+    len = comp->tal.len;
+    if (len < 2 || (size = entry[0] << 8 | entry[1]) > ROM_MEMORY - ROM_START || size + 2 > len)
+        return 0;
+
+    rom = resetRom(comp);
+    memcpy(rom->data + ROM_START, entry + 2, size);
+    rom->length = ROM_START + size;
+
+    for (pos = size + 2; pos < len; pos = end + 1) {
+        for (end = pos + 2; end < len && entry[end] != '\0'; end++);
+        if (end >= len)
+            return 0;
+
+        UR_defineLabel(rom, (const char*)entry + pos + 2, end - pos - 2, entry[pos] << 8 | entry[pos + 1]);
+    }
+
+    resetTal(comp);
+    return 1;
+}
+
+/* assembles comp->tal into comp->rom, returns 0 and sets comp->err.msg if it didn't assemble */
+int assembleTal(UCompiler *comp) {
+    if (!UR_assemble(resetRom(comp), comp->tal.buf)) {
+        sprintf(comp->err.msg, "Assembler error!\n\t%s", comp->rom->err);
+        return 0;
+    }
+
+    return 1;
+}
+
+int UC_assembleTal(UCompiler *comp, const uint8_t **rom, size_t *len) {
+    if (!assembleTal(comp))
+        return 0;
+
+    *rom = comp->rom->data + ROM_START;
+    *len = UR_romSize(comp->rom);
+    return 1;
+}
+
+int UC_compileRom(UCompiler *comp, const char *src, const uint8_t **rom, size_t *len) {
+    uint64_t key = 0;
+
+    if (comp->cache)
+        key = UK_key(src, strlen(src), &comp->opts, 1);
+
+    if (comp->cache == NULL || !loadCachedRom(comp, key)) {
+        if (!compileSource(comp, src) || !assembleTal(comp))
+            return 0;
+
+        if (comp->cache)
+            storeCachedRom(comp, key);
+    }
+
+    *rom = comp->rom->data + ROM_START;
+    *len = UR_romSize(comp->rom);
+    return 1;
+}
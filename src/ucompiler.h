@@ -0,0 +1,44 @@
+#ifndef UCOMPILER_H
+#define UCOMPILER_H
+
+#include "uxncle.h"
+#include "umem.h"
+#include "uerror.h"
+#include "uparse.h"
+#include "uasm.h"
+#include "urom.h"
+#include "ucache.h"
+
+/* ==================================[[ embedding api ]]================================== */
+
+/* everything one compile needs. the syntax tree arena, the uxntal buffer & the rom are kept between compiles so
+    compiling many sources in a row doesn't keep going back to malloc. a compiler holds no global state, so each
+    thread can compile with its own UCompiler at the same time. (running out of memory still exits) */
+typedef struct {
+    UOptions opts;
+    UError err; /* err.msg holds the message after a compile fails */
+    UArena arena; /* syntax trees are parsed into this */
+    size_t treeSize; /* arena bytes the last syntax tree took up */
+    UOutBuf tal; /* generated uxntal */
+    URom *rom; /* the assembled rom, allocated by the first UC_compileRom() */
+    UCache *cache; /* if set, outputs are looked up here before compiling & stored after. NULL by default */
+} UCompiler;
+
+/* opts can be NULL for no optimizations */
+void UC_initCompiler(UCompiler *comp, UOptions *opts);
+void UC_freeCompiler(UCompiler *comp);
+
+/* compiles the null terminated source to uxntal, returns 1 on success and sets *tal & *len to the generated text.
+    it lives in the compiler until the next compile. returns 0 and sets comp->err.msg if the source didn't compile */
+int UC_compileTal(UCompiler *comp, const char *src, const char **tal, size_t *len);
+
+/* like UC_compileTal(), but also assembles the uxntal. *rom & *len are set to the rom's bytes (loaded at
+    ROM_START), the whole address space & its labels are in comp->rom. comp->tal is left empty if the rom came from the
+    cache */
+int UC_compileRom(UCompiler *comp, const char *src, const uint8_t **rom, size_t *len);
+
+/* assembles the uxntal the last UC_compileTal() generated into comp->rom, for when both the uxntal & the rom are
+    needed without compiling the source twice. sets *rom & *len like UC_compileRom(), the rom isn't cached */
+int UC_assembleTal(UCompiler *comp, const uint8_t **rom, size_t *len);
+
+#endif
@@ -0,0 +1,31 @@
+/* vsnprintf() isn't part of strict c89 */
+#define _DEFAULT_SOURCE
+
+#include "uerror.h"
+
+void UE_initError(UError *err) {
+    err->jmp = NULL;
+    err->msg[0] = '\0';
+}
+
+void UE_raise(UError *err, const char *kind, const char *where, int whereLen, int line, const char *fmt, va_list args) {
+    char msg[UERROR_MSG_SIZE];
+    int len;
+
+    /* long tokens are cut off rather than overflowing the message */
+    if (where)
+        len = snprintf(msg, sizeof(msg), "%s at '%.*s' on line %d\n\t", kind, whereLen > 32 ? 32 : whereLen, where, line);
+    else
+        len = snprintf(msg, sizeof(msg), "%s!\n\t", kind);
+
+    if (len >= 0 && len < (int)sizeof(msg))
+        vsnprintf(msg + len, sizeof(msg) - len, fmt, args);
+
+    if (err == NULL || err->jmp == NULL) {
+        printf("%s\n", msg);
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(err->msg, msg, sizeof(msg));
+    longjmp(*err->jmp, 1);
+}
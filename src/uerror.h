@@ -0,0 +1,23 @@
+#ifndef UERROR_H
+#define UERROR_H
+
+#include "uxncle.h"
+
+#include <setjmp.h>
+
+#define UERROR_MSG_SIZE 256
+
+/* where compile errors go. if jmp is set the message is kept in msg and we longjmp() back to it, otherwise the
+    message is printed and we exit like the command line compiler always has. a NULL UError works like a NULL jmp */
+typedef struct {
+    jmp_buf *jmp;
+    char msg[UERROR_MSG_SIZE];
+} UError;
+
+void UE_initError(UError *err);
+
+/* builds "<kind> at '<where>' on line <line>\n\t<message>", or "<kind>!\n\t<message>" if where is NULL, then
+    raises it. never returns */
+void UE_raise(UError *err, const char *kind, const char *where, int whereLen, int line, const char *fmt, va_list args);
+
+#endif
@@ -0,0 +1,565 @@
+#include "uir.h"
+
+#define IMM_ANY -1
+
+/* pattern-only kinds, they never show up in a program */
+#define PAT_ANY 0xfe /* matches any instruction or literal, but not a label */
+#define PAT_CAPTURE 0xfd /* in a replacement, copies the matched instruction at index imm */
+
+/* IR_OP matches the op & modes exactly, IR_LIT matches the size & value (or IMM_ANY), IR_SYM matches the addressing
+    mode & symbol name (or any symbol if it's NULL) */
+typedef struct {
+    uint8_t kind;
+    uint8_t op;
+    uint8_t flags;
+    int32_t imm;
+    const char *sym;
+} UIRPattern;
+
+typedef struct {
+    int mCount;
+    UIRPattern match[5];
+    int rCount;
+    UIRPattern replace[3];
+} UIRRule;
+
+#define P_OP(op, modes) {IR_OP, op, modes, 0, NULL}
+#define P_BYTE(val) {IR_LIT, 0, 0, val, NULL}
+#define P_SHORT(val) {IR_LIT, 0, MODE_SHORT, val, NULL}
+#define P_CALL(name) {IR_SYM, ADDR_ABS, 0, 0, name}
+#define P_ADDR(addr) {IR_SYM, addr, 0, 0, NULL}
+#define P_ANY {PAT_ANY, 0, 0, 0, NULL}
+#define P_CAPTURE(i) {PAT_CAPTURE, 0, 0, i, NULL}
+
+/* a rule replaces at most as many instructions as it matches, so the rewrite can be done in place */
+static const UIRRule peepRules[] = {
+    /* widening right before narrowing */
+    {4, {P_BYTE(0x00), P_OP(OP_SWP, 0), P_OP(OP_SWP, 0), P_OP(OP_POP, 0)}, 0, {P_ANY}},
+    {2, {P_OP(OP_SWP, 0), P_OP(OP_POP, 0)}, 1, {P_OP(OP_NIP, 0)}},
+    /* inverted comparisons from tryTypeCast() & the conditional jumps */
+    {3, {P_OP(OP_EQU, 0), P_BYTE(0x01), P_OP(OP_NEQ, 0)}, 1, {P_OP(OP_NEQ, 0)}},
+    {3, {P_OP(OP_NEQ, 0), P_BYTE(0x01), P_OP(OP_NEQ, 0)}, 1, {P_OP(OP_EQU, 0)}},
+    {3, {P_OP(OP_EQU, MODE_SHORT), P_BYTE(0x01), P_OP(OP_NEQ, 0)}, 1, {P_OP(OP_NEQ, MODE_SHORT)}},
+    {3, {P_OP(OP_NEQ, MODE_SHORT), P_BYTE(0x01), P_OP(OP_NEQ, 0)}, 1, {P_OP(OP_EQU, MODE_SHORT)}},
+    /* a copy that's stored and then thrown away. only an address literal can sit between the copy & the store, anything
+        else could be operating on the copy */
+    {4, {P_OP(OP_DUP, MODE_SHORT), P_ADDR(ADDR_ZP), P_OP(OP_STZ, MODE_SHORT), P_OP(OP_POP, MODE_SHORT)}, 2, {P_CAPTURE(1), P_OP(OP_STZ, MODE_SHORT)}},
+    {4, {P_OP(OP_DUP, MODE_SHORT), P_BYTE(IMM_ANY), P_OP(OP_STZ, MODE_SHORT), P_OP(OP_POP, MODE_SHORT)}, 2, {P_CAPTURE(1), P_OP(OP_STZ, MODE_SHORT)}},
+    {4, {P_OP(OP_DUP, MODE_SHORT), P_ADDR(ADDR_ABS), P_OP(OP_STA, MODE_SHORT), P_OP(OP_POP, MODE_SHORT)}, 2, {P_CAPTURE(1), P_OP(OP_STA, MODE_SHORT)}},
+    {4, {P_OP(OP_DUP, MODE_SHORT), P_SHORT(IMM_ANY), P_OP(OP_STA, MODE_SHORT), P_OP(OP_POP, MODE_SHORT)}, 2, {P_CAPTURE(1), P_OP(OP_STA, MODE_SHORT)}},
+    {5, {P_OP(OP_DUP, MODE_SHORT), P_SHORT(IMM_ANY), P_CALL("poke-uxncle-short"), P_OP(OP_JSR, MODE_SHORT), P_OP(OP_POP, MODE_SHORT)},
+        3, {P_CAPTURE(1), P_CAPTURE(2), P_OP(OP_JSR, MODE_SHORT)}},
+    {4, {P_OP(OP_DUP, 0), P_ADDR(ADDR_ZP), P_OP(OP_STZ, 0), P_OP(OP_POP, 0)}, 2, {P_CAPTURE(1), P_OP(OP_STZ, 0)}},
+    {4, {P_OP(OP_DUP, 0), P_BYTE(IMM_ANY), P_OP(OP_STZ, 0), P_OP(OP_POP, 0)}, 2, {P_CAPTURE(1), P_OP(OP_STZ, 0)}},
+    {4, {P_OP(OP_DUP, 0), P_ADDR(ADDR_ABS), P_OP(OP_STA, 0), P_OP(OP_POP, 0)}, 2, {P_CAPTURE(1), P_OP(OP_STA, 0)}},
+    {4, {P_OP(OP_DUP, 0), P_SHORT(IMM_ANY), P_OP(OP_STA, 0), P_OP(OP_POP, 0)}, 2, {P_CAPTURE(1), P_OP(OP_STA, 0)}},
+    {5, {P_OP(OP_DUP, 0), P_SHORT(IMM_ANY), P_CALL("poke-uxncle"), P_OP(OP_JSR, MODE_SHORT), P_OP(OP_POP, 0)},
+        3, {P_CAPTURE(1), P_CAPTURE(2), P_OP(OP_JSR, MODE_SHORT)}},
+    /* keep mode instead of a copy */
+    {2, {P_OP(OP_DUP, MODE_SHORT), P_OP(OP_INC, MODE_SHORT)}, 1, {P_OP(OP_INC, MODE_SHORT | MODE_KEEP)}},
+    {2, {P_OP(OP_DUP, 0), P_OP(OP_INC, 0)}, 1, {P_OP(OP_INC, MODE_KEEP)}},
+    {2, {P_OP(OP_DUP, MODE_SHORT), P_OP(OP_LDA, MODE_SHORT)}, 1, {P_OP(OP_LDA, MODE_SHORT | MODE_KEEP)}},
+    {2, {P_OP(OP_DUP, MODE_SHORT), P_OP(OP_LDA, 0)}, 1, {P_OP(OP_LDA, MODE_KEEP)}},
+    {2, {P_OP(OP_DUP, 0), P_OP(OP_LDZ, MODE_SHORT)}, 1, {P_OP(OP_LDZ, MODE_SHORT | MODE_KEEP)}},
+    {2, {P_OP(OP_DUP, 0), P_OP(OP_LDZ, 0)}, 1, {P_OP(OP_LDZ, MODE_KEEP)}},
+    {3, {P_OP(OP_OVR, MODE_SHORT), P_OP(OP_OVR, MODE_SHORT), P_OP(OP_ADD, MODE_SHORT)}, 1, {P_OP(OP_ADD, MODE_SHORT | MODE_KEEP)}},
+    {3, {P_OP(OP_OVR, MODE_SHORT), P_OP(OP_OVR, MODE_SHORT), P_OP(OP_SUB, MODE_SHORT)}, 1, {P_OP(OP_SUB, MODE_SHORT | MODE_KEEP)}},
+    {3, {P_OP(OP_OVR, MODE_SHORT), P_OP(OP_OVR, MODE_SHORT), P_OP(OP_MUL, MODE_SHORT)}, 1, {P_OP(OP_MUL, MODE_SHORT | MODE_KEEP)}},
+    {3, {P_OP(OP_OVR, MODE_SHORT), P_OP(OP_OVR, MODE_SHORT), P_OP(OP_DIV, MODE_SHORT)}, 1, {P_OP(OP_DIV, MODE_SHORT | MODE_KEEP)}},
+    {3, {P_OP(OP_OVR, MODE_SHORT), P_OP(OP_OVR, MODE_SHORT), P_OP(OP_EQU, MODE_SHORT)}, 1, {P_OP(OP_EQU, MODE_SHORT | MODE_KEEP)}},
+    {3, {P_OP(OP_OVR, MODE_SHORT), P_OP(OP_OVR, MODE_SHORT), P_OP(OP_NEQ, MODE_SHORT)}, 1, {P_OP(OP_NEQ, MODE_SHORT | MODE_KEEP)}},
+    {3, {P_OP(OP_OVR, MODE_SHORT), P_OP(OP_OVR, MODE_SHORT), P_OP(OP_LTH, MODE_SHORT)}, 1, {P_OP(OP_LTH, MODE_SHORT | MODE_KEEP)}},
+    {3, {P_OP(OP_OVR, MODE_SHORT), P_OP(OP_OVR, MODE_SHORT), P_OP(OP_GTH, MODE_SHORT)}, 1, {P_OP(OP_GTH, MODE_SHORT | MODE_KEEP)}},
+    /* literals that don't need to exist */
+    {2, {P_SHORT(IMM_ANY), P_OP(OP_POP, MODE_SHORT)}, 0, {P_ANY}},
+    {2, {P_BYTE(IMM_ANY), P_OP(OP_POP, 0)}, 0, {P_ANY}},
+    {2, {P_OP(OP_DUP, MODE_SHORT), P_OP(OP_POP, MODE_SHORT)}, 0, {P_ANY}},
+    {2, {P_OP(OP_DUP, 0), P_OP(OP_POP, 0)}, 0, {P_ANY}},
+    {2, {P_SHORT(0x0001), P_OP(OP_ADD, MODE_SHORT)}, 1, {P_OP(OP_INC, MODE_SHORT)}},
+    {2, {P_BYTE(0x01), P_OP(OP_ADD, 0)}, 1, {P_OP(OP_INC, 0)}},
+    /* identities left behind by strength reduction & the other rewrites */
+    {2, {P_SHORT(0x0000), P_OP(OP_ADD, MODE_SHORT)}, 0, {P_ANY}},
+    {2, {P_BYTE(0x00), P_OP(OP_ADD, 0)}, 0, {P_ANY}},
+    {2, {P_SHORT(0x0000), P_OP(OP_SUB, MODE_SHORT)}, 0, {P_ANY}},
+    {2, {P_BYTE(0x00), P_OP(OP_SUB, 0)}, 0, {P_ANY}},
+    {2, {P_SHORT(0x0001), P_OP(OP_MUL, MODE_SHORT)}, 0, {P_ANY}},
+    {2, {P_BYTE(0x01), P_OP(OP_MUL, 0)}, 0, {P_ANY}},
+    {2, {P_SHORT(0x0001), P_OP(OP_DIV, MODE_SHORT)}, 0, {P_ANY}},
+    {2, {P_BYTE(0x01), P_OP(OP_DIV, 0)}, 0, {P_ANY}},
+    {2, {P_BYTE(0x00), P_OP(OP_SFT, MODE_SHORT)}, 0, {P_ANY}},
+    {2, {P_BYTE(0x00), P_OP(OP_SFT, 0)}, 0, {P_ANY}},
+    {2, {P_SHORT(0x0000), P_OP(OP_MUL, MODE_SHORT)}, 2, {P_OP(OP_POP, MODE_SHORT), P_SHORT(0x0000)}},
+    {2, {P_BYTE(0x00), P_OP(OP_MUL, 0)}, 2, {P_OP(OP_POP, 0), P_BYTE(0x00)}},
+    {2, {P_OP(OP_DUP, MODE_SHORT), P_OP(OP_SUB, MODE_SHORT)}, 2, {P_OP(OP_POP, MODE_SHORT), P_SHORT(0x0000)}},
+    {2, {P_OP(OP_DUP, 0), P_OP(OP_SUB, 0)}, 2, {P_OP(OP_POP, 0), P_BYTE(0x00)}},
+    {2, {P_OP(OP_DUP, MODE_SHORT), P_OP(OP_EOR, MODE_SHORT)}, 2, {P_OP(OP_POP, MODE_SHORT), P_SHORT(0x0000)}},
+    {2, {P_OP(OP_DUP, 0), P_OP(OP_EOR, 0)}, 2, {P_OP(OP_POP, 0), P_BYTE(0x00)}},
+};
+
+static const char *opNames[] = {
+    "LIT", "INC", "POP", "NIP", "SWP", "ROT", "DUP", "OVR",
+    "EQU", "NEQ", "GTH", "LTH", "JMP", "JCN", "JSR", "STH",
+    "LDZ", "STZ", "LDR", "STR", "LDA", "STA", "DEI", "DEO",
+    "ADD", "SUB", "MUL", "DIV", "AND", "ORA", "EOR", "SFT"
+};
+
+static const char addrRunes[] = {';', '.', ','};
+
+void UI_initProgram(UIRProgram *prog) {
+    prog->count = 0;
+    prog->cap = 256;
+    prog->code = (UIRInstr*)UM_realloc(NULL, sizeof(UIRInstr) * prog->cap);
+    prog->bCount = 0;
+    prog->bCap = 32;
+    prog->blocks = (UIRBlock*)UM_realloc(NULL, sizeof(UIRBlock) * prog->bCap);
+    prog->lblCount = 0;
+    UT_initInternTable(&prog->syms);
+    UM_initArena(&prog->strings, 0x1000);
+}
+
+void UI_freeProgram(UIRProgram *prog) {
+    UM_freearray(prog->code);
+    UM_freearray(prog->blocks);
+    UT_freeInternTable(&prog->syms);
+    UM_freeArena(&prog->strings);
+}
+
+int UI_newLabel(UIRProgram *prog) {
+    return prog->lblCount++;
+}
+
+int UI_symbol(UIRProgram *prog, const char *name) {
+    int len = strlen(name);
+    int sym = UT_find(&prog->syms, name, len);
+    char *str;
+
+    if (sym != -1)
+        return sym;
+
+    /* the intern table doesn't own its strings */
+    str = (char*)UM_arenaAlloc(&prog->strings, len + 1);
+    memcpy(str, name, len);
+    return UT_intern(&prog->syms, str, len);
+}
+
+const char *UI_symbolName(UIRProgram *prog, int sym) {
+    return prog->syms.syms[sym].str;
+}
+
+/* ==================================[[ builder ]]================================== */
+
+void pushInstr(UIRProgram *prog, UIRKind kind, int op, int flags, int imm) {
+    UIRInstr *instr;
+
+    UM_growarray(UIRInstr, prog->code, prog->count, prog->cap);
+    instr = &prog->code[prog->count++];
+    instr->kind = kind;
+    instr->op = op;
+    instr->flags = flags;
+    instr->imm = imm;
+}
+
+void UI_op(UIRProgram *prog, UOpcode op, int modes) {
+    pushInstr(prog, IR_OP, op, modes, 0);
+}
+
+void UI_lit(UIRProgram *prog, int value, int isShort) {
+    if (isShort)
+        pushInstr(prog, IR_LIT, 0, MODE_SHORT, value & 0xffff);
+    else
+        pushInstr(prog, IR_LIT, 0, 0, value & 0xff);
+}
+
+void UI_sym(UIRProgram *prog, UIRAddr addr, int sym) {
+    pushInstr(prog, IR_SYM, addr, 0, sym);
+}
+
+void UI_lblRef(UIRProgram *prog, UIRAddr addr, int lbl) {
+    pushInstr(prog, IR_LBLREF, addr, 0, lbl);
+}
+
+void UI_label(UIRProgram *prog, int lbl) {
+    pushInstr(prog, IR_LABEL, 0, 0, lbl);
+}
+
+/* ==================================[[ basic blocks ]]================================== */
+
+/* control never falls through past JMP, and JCN might not */
+int endsBlock(UIRInstr *instr) {
+    return instr->kind == IR_OP && (instr->op == OP_JMP || instr->op == OP_JCN);
+}
+
+void closeBlock(UIRProgram *prog, int start, int end) {
+    if (end <= start)
+        return;
+
+    UM_growarray(UIRBlock, prog->blocks, prog->bCount, prog->bCap);
+    prog->blocks[prog->bCount].start = start;
+    prog->blocks[prog->bCount].end = end;
+    prog->bCount++;
+}
+
+void UI_buildBlocks(UIRProgram *prog) {
+    int i, start = 0;
+
+    prog->bCount = 0;
+    for (i = 0; i < prog->count; i++) {
+        if (prog->code[i].kind == IR_LABEL) {
+            closeBlock(prog, start, i);
+            start = i;
+        } else if (endsBlock(&prog->code[i])) {
+            closeBlock(prog, start, i + 1);
+            start = i + 1;
+        }
+    }
+
+    closeBlock(prog, start, prog->count);
+}
+
+/* ==================================[[ peephole ]]================================== */
+
+int matchInstr(UIRProgram *prog, const UIRPattern *pat, UIRInstr *instr) {
+    if (pat->kind == PAT_ANY)
+        return instr->kind != IR_LABEL;
+
+    if (pat->kind != instr->kind)
+        return 0;
+
+    switch(instr->kind) {
+        case IR_OP: return pat->op == instr->op && pat->flags == instr->flags;
+        case IR_LIT: return pat->flags == instr->flags && (pat->imm == IMM_ANY || pat->imm == instr->imm);
+        case IR_SYM: return pat->op == instr->op && (pat->sym == NULL || strcmp(pat->sym, UI_symbolName(prog, instr->imm)) == 0);
+        default: return 0;
+    }
+}
+
+/* tries to match the rule against the end of code[start..*end), rewriting it if it matches */
+int applyIRRule(UIRProgram *prog, const UIRRule *rule, int start, int *end) {
+    UIRInstr replaced[3];
+    UIRInstr *matched;
+    int i;
+
+    if (*end - start < rule->mCount)
+        return 0;
+
+    matched = &prog->code[*end - rule->mCount];
+    for (i = 0; i < rule->mCount; i++) {
+        if (!matchInstr(prog, &rule->match[i], &matched[i]))
+            return 0;
+    }
+
+    /* build the replacement before we overwrite the matched instructions */
+    for (i = 0; i < rule->rCount; i++) {
+        const UIRPattern *pat = &rule->replace[i];
+
+        if (pat->kind == PAT_CAPTURE) {
+            replaced[i] = matched[pat->imm];
+        } else {
+            replaced[i].kind = pat->kind;
+            replaced[i].op = pat->op;
+            replaced[i].flags = pat->flags;
+            replaced[i].imm = pat->imm;
+        }
+    }
+
+    memcpy(matched, replaced, sizeof(UIRInstr) * rule->rCount);
+    *end -= rule->mCount - rule->rCount;
+    return 1;
+}
+
+int UI_peephole(UIRProgram *prog) {
+    int read, write = 0, start = 0, rewrites = 0, rewrote, i;
+
+    /* the program is compacted in place, every instruction is appended to the output and the rules are matched
+        against the tail of the current block. a rewrite can expose another match, so keep going until none do */
+    for (read = 0; read < prog->count; read++) {
+        UIRInstr instr = prog->code[read];
+        prog->code[write++] = instr;
+
+        if (instr.kind == IR_LABEL) {
+            start = write;
+            continue;
+        }
+
+        do {
+            rewrote = 0;
+            for (i = 0; i < sizeof(peepRules)/sizeof(UIRRule); i++) {
+                if (applyIRRule(prog, &peepRules[i], start, &write)) {
+                    rewrote = 1;
+                    rewrites++;
+                    break;
+                }
+            }
+        } while (rewrote);
+
+        if (endsBlock(&instr))
+            start = write;
+    }
+
+    prog->count = write;
+    UI_buildBlocks(prog);
+    return rewrites;
+}
+
+/* ==================================[[ strength reduction ]]================================== */
+
+/* instructions a multiply by a constant can turn into */
+#define MAX_REDUCED 7
+
+/* rough cost of each opcode on the emulators we target, a literal costs as much as LIT */
+static const uint8_t opCosts[] = {
+    1, 1, 1, 1, 1, 1, 1, 1, /* LIT INC POP NIP SWP ROT DUP OVR */
+    1, 1, 1, 1, 1, 1, 1, 1, /* EQU NEQ GTH LTH JMP JCN JSR STH */
+    2, 2, 2, 2, 2, 2, 2, 2, /* LDZ STZ LDR STR LDA STA DEI DEO */
+    1, 1, 4, 6, 1, 1, 1, 1  /* ADD SUB MUL DIV AND ORA EOR SFT */
+};
+
+int instrCost(UIRInstr *instr) {
+    return opCosts[instr->kind == IR_OP ? instr->op : OP_LIT];
+}
+
+/* returns the exponent if val is a power of two, otherwise -1 */
+int log2Exact(unsigned int val) {
+    int exp = 0;
+
+    if (val == 0 || (val & (val - 1)) != 0)
+        return -1;
+
+    while (val >>= 1)
+        exp++;
+    return exp;
+}
+
+void addReduced(UIRInstr *seq, int *len, UIRKind kind, int op, int flags, int imm) {
+    seq[*len].kind = kind;
+    seq[*len].op = op;
+    seq[*len].flags = flags;
+    seq[*len].imm = imm;
+    (*len)++;
+}
+
+/* SFT takes a byte, the left shift in the high nibble & the right shift in the low nibble */
+void addShift(UIRInstr *seq, int *len, int width, int left, int right) {
+    addReduced(seq, len, IR_LIT, 0, 0, (left << 4) | right);
+    addReduced(seq, len, IR_OP, OP_SFT, width, 0);
+}
+
+/* fills seq with the shifts & adds that compute `x lit op` for the x under the literal, returns its length or 0 if
+    there's nothing cheaper than the multiply or divide */
+int reduceConstant(UIRInstr *lit, UIRInstr *op, UIRInstr *seq) {
+    int width, bits, exp, low, len = 0, i, cost = 0;
+    unsigned int val, rest;
+
+    if (lit->kind != IR_LIT || op->kind != IR_OP || (op->op != OP_MUL && op->op != OP_DIV))
+        return 0;
+
+    /* the literal has to be as wide as the operation, and keep or return mode is left alone */
+    width = op->flags;
+    if ((width != 0 && width != MODE_SHORT) || lit->flags != width)
+        return 0;
+
+    bits = width ? 16 : 8;
+    val = lit->imm;
+    exp = log2Exact(val);
+
+    /* x*1 & x/1 are the peephole's job, DIV is unsigned so a right shift is exact */
+    if (exp > 0) {
+        addShift(seq, &len, width, op->op == OP_MUL ? exp : 0, op->op == OP_DIV ? exp : 0);
+        return len;
+    } else if (op->op == OP_DIV || val == 0) {
+        return 0;
+    }
+
+    /* x * (2^d + 1) << low or x * (2^d - 1) << low */
+    for (low = 0; !(val & (1u << low)); low++);
+    rest = val >> low;
+    if ((exp = log2Exact(rest - 1)) > 0) {
+        addReduced(seq, &len, IR_OP, OP_DUP, width, 0);
+        addShift(seq, &len, width, exp, 0);
+        addReduced(seq, &len, IR_OP, OP_ADD, width, 0);
+    } else if ((exp = log2Exact(rest + 1)) > 0 && exp < bits) {
+        addReduced(seq, &len, IR_OP, OP_DUP, width, 0);
+        addShift(seq, &len, width, exp, 0);
+        addReduced(seq, &len, IR_OP, OP_SWP, width, 0);
+        addReduced(seq, &len, IR_OP, OP_SUB, width, 0);
+    } else {
+        return 0;
+    }
+
+    if (low > 0)
+        addShift(seq, &len, width, low, 0);
+
+    for (i = 0; i < len; i++)
+        cost += instrCost(&seq[i]);
+
+    return cost < instrCost(lit) + instrCost(op) ? len : 0;
+}
+
+int UI_strengthReduce(UIRProgram *prog) {
+    UIRInstr seq[MAX_REDUCED];
+    UIRInstr *old = prog->code;
+    int oldCount = prog->count, reduced = 0, len, i, j;
+
+    /* a reduction can be longer than what it replaces, so the program is rebuilt into a fresh buffer */
+    prog->code = (UIRInstr*)UM_realloc(NULL, sizeof(UIRInstr) * prog->cap);
+    prog->count = 0;
+
+    for (i = 0; i < oldCount; i++) {
+        if (i + 1 < oldCount && (len = reduceConstant(&old[i], &old[i + 1], seq)) > 0) {
+            for (j = 0; j < len; j++)
+                pushInstr(prog, seq[j].kind, seq[j].op, seq[j].flags, seq[j].imm);
+            reduced++;
+            i++;
+            continue;
+        }
+
+        pushInstr(prog, old[i].kind, old[i].op, old[i].flags, old[i].imm);
+    }
+
+    UM_freearray(old);
+    UI_buildBlocks(prog);
+    return reduced;
+}
+
+/* ==================================[[ branch relaxation ]]================================== */
+
+/* returns the size of the instruction once assembled */
+int instrSize(UIRInstr *instr) {
+    switch(instr->kind) {
+        case IR_OP: return 1;
+        case IR_LIT: return (instr->flags & MODE_SHORT) ? 3 : 2;
+        case IR_SYM: case IR_LBLREF: return instr->op == ADDR_ABS ? 3 : 2;
+        default: return 0;
+    }
+}
+
+int UI_relaxBranches(UIRProgram *prog) {
+    int *lblAddrs, i, addr, rel, widened = 0, changed;
+
+    if (prog->lblCount == 0)
+        return 0;
+
+    lblAddrs = (int*)UM_realloc(NULL, sizeof(int) * prog->lblCount);
+
+    /* widening a jump can push another one out of range, so repeat until nothing changes. jumps only ever grow, so
+        this always ends */
+    do {
+        changed = 0;
+
+        for (i = 0, addr = 0; i < prog->count; i++) {
+            if (prog->code[i].kind == IR_LABEL)
+                lblAddrs[prog->code[i].imm] = addr;
+            addr += instrSize(&prog->code[i]);
+        }
+
+        for (i = 0, addr = 0; i < prog->count - 1; addr += instrSize(&prog->code[i++])) {
+            UIRInstr *ref = &prog->code[i], *jmp = &prog->code[i + 1];
+
+            if (ref->kind != IR_LBLREF || ref->op != ADDR_REL || jmp->kind != IR_OP)
+                continue;
+            if (jmp->op != OP_JMP && jmp->op != OP_JCN && jmp->op != OP_JSR)
+                continue;
+
+            /* relative to the end of the jump */
+            rel = lblAddrs[ref->imm] - (addr + 3);
+            if (rel >= -128 && rel <= 127)
+                continue;
+
+            ref->op = ADDR_ABS;
+            jmp->flags |= MODE_SHORT;
+            widened++;
+            changed = 1;
+        }
+    } while (changed);
+
+    UM_freearray(lblAddrs);
+    return widened;
+}
+
+/* ==================================[[ printer ]]================================== */
+
+const char *UI_opcodeName(uint8_t op, char *buf) {
+    int base = op & 0x1f;
+    char *current = buf;
+
+    if (op == 0x00) {
+        strcpy(buf, "BRK");
+        return buf;
+    }
+
+    strcpy(buf, opNames[base]);
+    current += 3;
+
+    if (op & MODE_SHORT)
+        *current++ = '2';
+    /* the keep bit is what makes LIT a literal, so it isn't written */
+    if ((op & MODE_KEEP) && base != OP_LIT)
+        *current++ = 'k';
+    if (op & MODE_RETURN)
+        *current++ = 'r';
+    *current = '\0';
+
+    return buf;
+}
+
+int UI_instrCount(UIRProgram *prog) {
+    int i, count = 0;
+
+    for (i = 0; i < prog->count; i++) {
+        if (prog->code[i].kind != IR_LABEL)
+            count++;
+    }
+
+    return count;
+}
+
+void UI_print(UIRProgram *prog, UOutBuf *out) {
+    char name[8];
+    int i, lineStart = 1;
+
+    /* operands share a line with the instruction that uses them */
+    for (i = 0; i < prog->count; i++) {
+        UIRInstr *instr = &prog->code[i];
+        USymbol *sym;
+
+        switch(instr->kind) {
+            case IR_OP:
+                UA_puts(out, UI_opcodeName(instr->op | instr->flags, name));
+                UA_putc(out, '\n');
+                lineStart = 1;
+                break;
+            case IR_LIT:
+                UA_putc(out, '#');
+                if (instr->flags & MODE_SHORT)
+                    UA_hex16(out, instr->imm);
+                else
+                    UA_hex8(out, instr->imm);
+                UA_putc(out, ' ');
+                lineStart = 0;
+                break;
+            case IR_SYM:
+                sym = &prog->syms.syms[instr->imm];
+                UA_putc(out, addrRunes[instr->op]);
+                UA_write(out, sym->str, sym->len);
+                UA_putc(out, ' ');
+                lineStart = 0;
+                break;
+            case IR_LBLREF:
+                UA_putc(out, addrRunes[instr->op]);
+                UA_puts(out, "&lbl");
+                UA_dec(out, instr->imm);
+                UA_putc(out, ' ');
+                lineStart = 0;
+                break;
+            case IR_LABEL:
+                UA_puts(out, lineStart ? "&lbl" : "\n&lbl");
+                UA_dec(out, instr->imm);
+                UA_putc(out, '\n');
+                lineStart = 1;
+                break;
+        }
+    }
+
+    if (!lineStart)
+        UA_putc(out, '\n');
+}
@@ -0,0 +1,100 @@
+#ifndef UIR_H
+#define UIR_H
+
+#include "uxncle.h"
+#include "umem.h"
+#include "utable.h"
+#include "uasm.h"
+
+/* uxn opcodes, in encoding order */
+typedef enum {
+    OP_LIT, OP_INC, OP_POP, OP_NIP, OP_SWP, OP_ROT, OP_DUP, OP_OVR,
+    OP_EQU, OP_NEQ, OP_GTH, OP_LTH, OP_JMP, OP_JCN, OP_JSR, OP_STH,
+    OP_LDZ, OP_STZ, OP_LDR, OP_STR, OP_LDA, OP_STA, OP_DEI, OP_DEO,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_AND, OP_ORA, OP_EOR, OP_SFT
+} UOpcode;
+
+/* BRK is LIT without keep mode */
+#define OP_BRK OP_LIT
+
+/* mode bits, or'd with the opcode they make the encoded byte */
+#define MODE_SHORT  0x20
+#define MODE_RETURN 0x40
+#define MODE_KEEP   0x80
+
+typedef enum {
+    IR_OP, /* op & flags are the opcode & modes */
+    IR_LIT, /* imm is the value, flags is MODE_SHORT for a short literal */
+    IR_SYM, /* literal address of a symbol, op is the UIRAddr & imm is the symbol id */
+    IR_LBLREF, /* literal address of a local label, op is the UIRAddr & imm is the label id */
+    IR_LABEL /* defines a local label, imm is the label id */
+} UIRKind;
+
+typedef enum {
+    ADDR_ABS, /* ;label */
+    ADDR_ZP, /* .label */
+    ADDR_REL /* ,label */
+} UIRAddr;
+
+typedef struct {
+    uint8_t kind;
+    uint8_t op;
+    uint8_t flags;
+    int32_t imm;
+} UIRInstr;
+
+typedef struct {
+    int start; /* index of the first instruction */
+    int end; /* index after the last instruction */
+} UIRBlock;
+
+typedef struct {
+    UIRInstr *code;
+    int count;
+    int cap;
+    UIRBlock *blocks; /* filled by UI_buildBlocks() */
+    int bCount;
+    int bCap;
+    int lblCount; /* local labels handed out */
+    UInternTable syms; /* IR_SYM ids index into this */
+    UArena strings; /* symbol names live here */
+} UIRProgram;
+
+void UI_initProgram(UIRProgram *prog);
+void UI_freeProgram(UIRProgram *prog);
+
+int UI_newLabel(UIRProgram *prog);
+
+/* returns the id of the symbol, eg. "print-decimal" or "uxncle-zp/v0" */
+int UI_symbol(UIRProgram *prog, const char *name);
+const char *UI_symbolName(UIRProgram *prog, int sym);
+
+void UI_op(UIRProgram *prog, UOpcode op, int modes);
+void UI_lit(UIRProgram *prog, int value, int isShort);
+void UI_sym(UIRProgram *prog, UIRAddr addr, int sym);
+void UI_lblRef(UIRProgram *prog, UIRAddr addr, int lbl);
+void UI_label(UIRProgram *prog, int lbl);
+
+/* splits the program into basic blocks, a block starts at a label and ends after a jump */
+void UI_buildBlocks(UIRProgram *prog);
+
+/* rewrites redundant instruction sequences inside of each basic block, returns the number of rewrites */
+int UI_peephole(UIRProgram *prog);
+
+/* turns multiplies & divides by a constant into shifts (and adds) when that's cheaper, returns the number it
+    replaced. run it before UI_peephole(), which cleans up what's left */
+int UI_strengthReduce(UIRProgram *prog);
+
+/* turns relative jumps whose label is out of range into absolute ones, returns the number of jumps it widened */
+int UI_relaxBranches(UIRProgram *prog);
+
+/* returns the number of instructions & literals (not labels) */
+int UI_instrCount(UIRProgram *prog);
+
+/* prints the program as uxntal */
+void UI_print(UIRProgram *prog, UOutBuf *out);
+
+/* returns the mnemonic of an encoded opcode, eg. "ADD2k". buf needs room for at least 7 bytes */
+const char *UI_opcodeName(uint8_t op, char *buf);
+
+#endif
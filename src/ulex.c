@@ -1,25 +1,32 @@
 #include "umem.h"
 #include "ulex.h"
 
-typedef struct {
-    UTokenType type;
-    const char *word;
-    int len;
-} UReservedWord;
-
-UReservedWord reservedWords[] = {
-    {TOKEN_CHAR, "char", 4},
-    {TOKEN_INT, "int", 3},
-    {TOKEN_VOID, "void", 4},
-    {TOKEN_BOOL, "bool", 4},
-    {TOKEN_WHILE, "while", 5},
-    {TOKEN_FOR, "for", 3},
-    {TOKEN_PRINTINT, "prntint", 7},
-    {TOKEN_IF, "if", 2},
-    {TOKEN_ELSE, "else", 4},
-};
+#include <assert.h>
+
+/* reserved words, KEYWORD(token type, word, first character, last character). this list is the only place keywords are
+    defined. the first & last characters are spelled out so KEYWORD_HASH() is a constant expression, which means a hash
+    collision between two keywords is caught at compile time as a duplicate case label in identifierType(). c89 can't
+    read a literal's characters in a constant expression, so UL_initLexState() asserts they match the word */
+#define RESERVED_WORDS \
+    KEYWORD(TOKEN_CHAR, "char", 'c', 'r') \
+    KEYWORD(TOKEN_INT, "int", 'i', 't') \
+    KEYWORD(TOKEN_VOID, "void", 'v', 'd') \
+    KEYWORD(TOKEN_BOOL, "bool", 'b', 'l') \
+    KEYWORD(TOKEN_WHILE, "while", 'w', 'e') \
+    KEYWORD(TOKEN_FOR, "for", 'f', 'r') \
+    KEYWORD(TOKEN_PRINTINT, "prntint", 'p', 't') \
+    KEYWORD(TOKEN_IF, "if", 'i', 'f') \
+    KEYWORD(TOKEN_ELSE, "else", 'e', 'e')
+
+/* perfect hash for the words above */
+#define KEYWORD_HASH(len, first, last) (((len) + (first) * 2 + (last) * 3) & 31)
 
 void UL_initLexState(ULexState *state, const char *src) {
+#define KEYWORD(type, word, first, last) \
+    assert(word[0] == (first) && word[sizeof(word)-2] == (last));
+    RESERVED_WORDS
+#undef KEYWORD
+
     state->current = (char*)src;
     state->line = 1;
     state->last = TOKEN_ERR;
@@ -110,13 +117,16 @@ void skipWhitespace(ULexState *state) {
 }
 
 UTokenType identifierType(ULexState *state) {
-    int i;
     int len = state->current - state->start;
 
-    /* walk through each reserved word and compare it */
-    for (i = 0; i < sizeof(reservedWords)/sizeof(UReservedWord); i++) {
-        if (reservedWords[i].len == len && !memcmp(state->start, reservedWords[i].word, len))
-            return reservedWords[i].type;
+    /* one probe into the keyword hash, then make sure it's actually the reserved word */
+    switch (KEYWORD_HASH(len, state->start[0], state->start[len-1])) {
+#define KEYWORD(type, word, first, last) \
+        case KEYWORD_HASH(sizeof(word)-1, first, last): \
+            return (len == sizeof(word)-1 && !memcmp(state->start, word, len)) ? type : TOKEN_IDENT;
+        RESERVED_WORDS
+#undef KEYWORD
+        default: break;
     }
 
     /* it wasn't found in the reserved word list */
@@ -1,5 +1,15 @@
 #include "umem.h"
 
+/* every arena allocation is aligned to this */
+typedef union {
+    long l;
+    double d;
+    void *p;
+} UMaxAlign;
+
+#define ARENA_ALIGN(sz) (((sz) + sizeof(UMaxAlign) - 1) & ~(sizeof(UMaxAlign) - 1))
+#define CHUNK_HEADER ARENA_ALIGN(sizeof(UArenaChunk))
+
 void* UM_realloc(void *buf, size_t size) {
     void *newBuf;
 
@@ -15,4 +25,118 @@ void* UM_realloc(void *buf, size_t size) {
     }
 
     return newBuf;
-}
\ No newline at end of file
+}
+
+/* ==================================[[ region allocator ]]================================== */
+
+void UM_initArena(UArena *arena, size_t chunkSize) {
+    arena->head = NULL;
+    arena->spare = NULL;
+    arena->chunkSize = chunkSize ? chunkSize : ARENA_CHUNK_SIZE;
+    arena->used = 0;
+    arena->reserved = 0;
+    arena->peak = 0;
+    arena->peakReserved = 0;
+    arena->chunks = 0;
+}
+
+UArenaChunk *newChunk(UArena *arena, size_t size) {
+    UArenaChunk *chunk;
+
+    /* spares are always regular sized, they're already counted in reserved */
+    if (size == arena->chunkSize && arena->spare) {
+        chunk = arena->spare;
+        arena->spare = chunk->next;
+        chunk->used = 0;
+        return chunk;
+    }
+
+    chunk = (UArenaChunk*)UM_realloc(NULL, CHUNK_HEADER + size);
+
+    chunk->size = size;
+    chunk->used = 0;
+
+    arena->reserved += size;
+    arena->chunks++;
+    if (arena->reserved > arena->peakReserved)
+        arena->peakReserved = arena->reserved;
+
+    return chunk;
+}
+
+void* UM_arenaAlloc(UArena *arena, size_t size) {
+    UArenaChunk *chunk = arena->head;
+    void *buf;
+
+    size = ARENA_ALIGN(size);
+
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        if (size > arena->chunkSize / 4) {
+            /* big allocations get their own chunk, which is linked *behind* the head so the rest of the head chunk isn't wasted */
+            chunk = newChunk(arena, size);
+            if (arena->head) {
+                chunk->next = arena->head->next;
+                arena->head->next = chunk;
+            } else {
+                chunk->next = NULL;
+                arena->head = chunk;
+            }
+        } else {
+            chunk = newChunk(arena, arena->chunkSize);
+            chunk->next = arena->head;
+            arena->head = chunk;
+        }
+    }
+
+    buf = (char*)chunk + CHUNK_HEADER + chunk->used;
+    chunk->used += size;
+
+    arena->used += size;
+    if (arena->used > arena->peak)
+        arena->peak = arena->used;
+
+    memset(buf, 0, size);
+    return buf;
+}
+
+void freeChunks(UArenaChunk *chunk) {
+    UArenaChunk *next;
+
+    while (chunk) {
+        next = chunk->next;
+        UM_free(chunk);
+        chunk = next;
+    }
+}
+
+void UM_freeArena(UArena *arena) {
+    freeChunks(arena->head);
+    freeChunks(arena->spare);
+
+    arena->head = NULL;
+    arena->spare = NULL;
+    arena->used = 0;
+    arena->reserved = 0;
+    arena->chunks = 0;
+}
+
+void UM_resetArena(UArena *arena) {
+    UArenaChunk *chunk = arena->head, *next;
+
+    /* regular chunks become spares, the big one-off chunks are freed */
+    while (chunk) {
+        next = chunk->next;
+        if (chunk->size == arena->chunkSize) {
+            chunk->next = arena->spare;
+            arena->spare = chunk;
+        } else {
+            arena->reserved -= chunk->size;
+            arena->chunks--;
+            UM_free(chunk);
+        }
+        chunk = next;
+    }
+
+    arena->head = NULL;
+    arena->used = 0;
+}
@@ -5,6 +5,9 @@
 
 #define GROW_FACTOR 2
 
+/* default size of each arena chunk, allocations bigger than this get their own chunk */
+#define ARENA_CHUNK_SIZE 0x10000
+
 void* UM_realloc(void *buf, size_t size);
 
 #define UM_freearray(buf) \
@@ -20,4 +23,35 @@ void* UM_realloc(void *buf, size_t size);
         buf = (type*)UM_realloc(buf, sizeof(type) * capacity); \
     }
 
-#endif
\ No newline at end of file
+/* ==================================[[ region allocator ]]================================== */
+
+typedef struct s_UArenaChunk {
+    struct s_UArenaChunk *next;
+    size_t size; /* usable bytes in this chunk */
+    size_t used; /* bytes handed out from this chunk */
+} UArenaChunk;
+
+typedef struct {
+    UArenaChunk *head; /* chunk we're currently allocating from */
+    UArenaChunk *spare; /* emptied chunks kept by UM_resetArena(), handed out again before allocating new ones */
+    size_t chunkSize;
+    size_t used; /* bytes currently handed out */
+    size_t reserved; /* bytes currently held in chunks, spares included */
+    size_t peak; /* high-water mark of used */
+    size_t peakReserved; /* high-water mark of reserved */
+    int chunks;
+} UArena;
+
+/* if chunkSize is 0, ARENA_CHUNK_SIZE is used */
+void UM_initArena(UArena *arena, size_t chunkSize);
+
+/* returns zero'd memory which lives until the arena is freed */
+void* UM_arenaAlloc(UArena *arena, size_t size);
+
+/* frees every allocation made from the arena at once */
+void UM_freeArena(UArena *arena);
+
+/* like UM_freeArena(), but keeps the chunks around so the next round of allocations doesn't hit malloc */
+void UM_resetArena(UArena *arena);
+
+#endif
@@ -0,0 +1,518 @@
+#include "umem.h"
+#include "uopt.h"
+
+/* optimizer state */
+typedef struct {
+    UASTRootNode *tree;
+    UScope **scopes; /* stack of active scopes */
+    int sCount;
+    int sCap;
+} UOptState;
+
+void foldAST(UOptState *state, UASTNode *node);
+
+/* ==================================[[ generic helper functions ]]================================== */
+
+UASTNode *newLiteral(UOptState *state, UASTNode *from, UASTNodeType type, int num) {
+    UASTIntNode *node = (UASTIntNode*)UM_arenaAlloc(state->tree->arena, sizeof(UASTIntNode));
+    node->_node.type = type;
+    node->_node.tkn = from->tkn;
+    node->_node.left = NULL;
+    node->_node.right = NULL;
+    node->num = num;
+    return (UASTNode*)node;
+}
+
+int isLiteral(UASTNode *node, UASTNodeType type) {
+    return node->type == type;
+}
+
+int isIntValue(UASTNode *node, int num) {
+    return node->type == NODE_INTLIT && ((UASTIntNode*)node)->num == num;
+}
+
+int litValue(UASTNode *node) {
+    return ((UASTIntNode*)node)->num & 0xFFFF;
+}
+
+/* returns the type the expression evaluates to, or TYPE_NONE if it's ill-typed (codegen reports those) */
+UVarType exprType(UOptState *state, UASTNode *node) {
+    switch(node->type) {
+        case NODE_INTLIT: return TYPE_INT;
+        case NODE_BOOLLIT: return TYPE_BOOL;
+        case NODE_CHARLIT: return TYPE_CHAR;
+        case NODE_VAR: {
+            UASTVarNode *nVar = (UASTVarNode*)node;
+            return state->scopes[nVar->scope]->vars[nVar->var].type;
+        }
+        case NODE_ASSIGN: return exprType(state, node->left);
+        case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV:
+            return exprType(state, node->left);
+        default:
+            return TYPE_BOOL; /* comparisons */
+    }
+}
+
+/* an expression is pure if evaluating it has no side effects */
+int isPure(UASTNode *node) {
+    if (node == NULL)
+        return 1;
+
+    if (node->type == NODE_ASSIGN)
+        return 0;
+
+    return isPure(node->left) && isPure(node->right);
+}
+
+int sameExpr(UASTNode *a, UASTNode *b) {
+    if (a == NULL || b == NULL)
+        return a == b;
+
+    if (a->type != b->type)
+        return 0;
+
+    switch(a->type) {
+        case NODE_INTLIT: case NODE_BOOLLIT: case NODE_CHARLIT: return litValue(a) == litValue(b);
+        case NODE_VAR:
+            return ((UASTVarNode*)a)->scope == ((UASTVarNode*)b)->scope && ((UASTVarNode*)a)->var == ((UASTVarNode*)b)->var;
+        default:
+            return sameExpr(a->left, b->left) && sameExpr(a->right, b->right);
+    }
+}
+
+/* ==================================[[ expressions ]]================================== */
+
+/* both sides are int literals */
+UASTNode *foldInts(UOptState *state, UASTNode *node) {
+    int l = litValue(node->left), r = litValue(node->right);
+
+    /* arithmetic wraps around at 16 bits, comparisons are unsigned (just like the uxn opcodes) */
+    switch(node->type) {
+        case NODE_ADD: return newLiteral(state, node, NODE_INTLIT, (l + r) & 0xFFFF);
+        case NODE_SUB: return newLiteral(state, node, NODE_INTLIT, (l - r) & 0xFFFF);
+        case NODE_MUL: return newLiteral(state, node, NODE_INTLIT, (int)(((long)l * r) & 0xFFFF));
+        case NODE_DIV:
+            if (r == 0) /* leave it for the runtime */
+                return node;
+            return newLiteral(state, node, NODE_INTLIT, l / r);
+        case NODE_EQUAL: return newLiteral(state, node, NODE_BOOLLIT, l == r);
+        case NODE_NEQUAL: return newLiteral(state, node, NODE_BOOLLIT, l != r);
+        case NODE_LESS: return newLiteral(state, node, NODE_BOOLLIT, l < r);
+        case NODE_GREATER: return newLiteral(state, node, NODE_BOOLLIT, l > r);
+        case NODE_LESS_EQUAL: return newLiteral(state, node, NODE_BOOLLIT, l <= r);
+        case NODE_GREATER_EQUAL: return newLiteral(state, node, NODE_BOOLLIT, l >= r);
+        default:
+            return node;
+    }
+}
+
+/* both sides are bool literals */
+UASTNode *foldBools(UOptState *state, UASTNode *node) {
+    int l = litValue(node->left), r = litValue(node->right);
+
+    switch(node->type) {
+        case NODE_EQUAL: return newLiteral(state, node, NODE_BOOLLIT, l == r);
+        case NODE_NEQUAL: return newLiteral(state, node, NODE_BOOLLIT, l != r);
+        default:
+            return node;
+    }
+}
+
+/* a char literal with another char literal, or an int literal that fits in a byte (codegen writes those as a char) */
+int isCharPair(UASTNode *node) {
+    UASTNode *left = node->left, *right = node->right;
+
+    if (!isLiteral(left, NODE_CHARLIT) && !isLiteral(right, NODE_CHARLIT))
+        return 0;
+
+    return (isLiteral(left, NODE_CHARLIT) || (isLiteral(left, NODE_INTLIT) && litValue(left) <= 0xFF)) &&
+        (isLiteral(right, NODE_CHARLIT) || (isLiteral(right, NODE_INTLIT) && litValue(right) <= 0xFF));
+}
+
+UASTNode *foldChars(UOptState *state, UASTNode *node) {
+    int l = litValue(node->left), r = litValue(node->right);
+
+    /* same as ints, but wrapping around at 8 bits */
+    switch(node->type) {
+        case NODE_ADD: return newLiteral(state, node, NODE_CHARLIT, (l + r) & 0xFF);
+        case NODE_SUB: return newLiteral(state, node, NODE_CHARLIT, (l - r) & 0xFF);
+        case NODE_MUL: return newLiteral(state, node, NODE_CHARLIT, (l * r) & 0xFF);
+        case NODE_DIV:
+            if (r == 0)
+                return node;
+            return newLiteral(state, node, NODE_CHARLIT, l / r);
+        case NODE_EQUAL: return newLiteral(state, node, NODE_BOOLLIT, l == r);
+        case NODE_NEQUAL: return newLiteral(state, node, NODE_BOOLLIT, l != r);
+        case NODE_LESS: return newLiteral(state, node, NODE_BOOLLIT, l < r);
+        case NODE_GREATER: return newLiteral(state, node, NODE_BOOLLIT, l > r);
+        case NODE_LESS_EQUAL: return newLiteral(state, node, NODE_BOOLLIT, l <= r);
+        case NODE_GREATER_EQUAL: return newLiteral(state, node, NODE_BOOLLIT, l >= r);
+        default:
+            return node;
+    }
+}
+
+/* one side isn't a literal, try the algebraic identities. these only apply to ints, anything else is a type error
+    codegen should still report */
+UASTNode *simplify(UOptState *state, UASTNode *node) {
+    UASTNode *left = node->left, *right = node->right;
+
+    if (exprType(state, left) != TYPE_INT || exprType(state, right) != TYPE_INT)
+        return node;
+
+    switch(node->type) {
+        case NODE_ADD: /* x+0, 0+x */
+            if (isIntValue(right, 0)) return left;
+            if (isIntValue(left, 0)) return right;
+            break;
+        case NODE_SUB: /* x-0, x-x */
+            if (isIntValue(right, 0)) return left;
+            if (isPure(left) && sameExpr(left, right)) return newLiteral(state, node, NODE_INTLIT, 0);
+            break;
+        case NODE_MUL: /* x*1, 1*x, x*0, 0*x */
+            if (isIntValue(right, 1)) return left;
+            if (isIntValue(left, 1)) return right;
+            if ((isIntValue(right, 0) && isPure(left)) || (isIntValue(left, 0) && isPure(right)))
+                return newLiteral(state, node, NODE_INTLIT, 0);
+            break;
+        case NODE_DIV: /* x/1 */
+            if (isIntValue(right, 1)) return left;
+            break;
+        default: break;
+    }
+
+    return node;
+}
+
+UASTNode *foldExpression(UOptState *state, UASTNode *node) {
+    if (node == NULL)
+        return NULL;
+
+    switch(node->type) {
+        case NODE_INTLIT: case NODE_BOOLLIT: case NODE_CHARLIT: case NODE_VAR:
+            return node;
+        case NODE_ASSIGN:
+            node->right = foldExpression(state, node->right);
+            return node;
+        default: break;
+    }
+
+    /* fold the children first so constants bubble up */
+    node->left = foldExpression(state, node->left);
+    node->right = foldExpression(state, node->right);
+
+    if (isLiteral(node->left, NODE_INTLIT) && isLiteral(node->right, NODE_INTLIT))
+        return foldInts(state, node);
+
+    if (isLiteral(node->left, NODE_BOOLLIT) && isLiteral(node->right, NODE_BOOLLIT))
+        return foldBools(state, node);
+
+    if (isCharPair(node))
+        return foldChars(state, node);
+
+    return simplify(state, node);
+}
+
+/* ==================================[[ statements ]]================================== */
+
+void foldAST(UOptState *state, UASTNode *node) {
+    /* STATE nodes hold the expression in node->left, and the next statement in node->right */
+    while (node) {
+        switch(node->type) {
+            case NODE_STATE_PRNT:
+            case NODE_STATE_EXPR:
+            case NODE_STATE_DECLARE_VAR:
+                node->left = foldExpression(state, node->left);
+                break;
+            case NODE_STATE_SCOPE:
+                UM_growarray(UScope*, state->scopes, state->sCount, state->sCap);
+                state->scopes[state->sCount++] = &((UASTScopeNode*)node)->scope;
+                foldAST(state, node->left);
+                state->sCount--;
+                break;
+            case NODE_STATE_IF:
+                node->left = foldExpression(state, node->left);
+                foldAST(state, ((UASTIfNode*)node)->block);
+                foldAST(state, ((UASTIfNode*)node)->elseBlock);
+                break;
+            case NODE_STATE_WHILE:
+                node->left = foldExpression(state, node->left);
+                foldAST(state, ((UASTWhileNode*)node)->block);
+                break;
+            case NODE_STATE_FOR: {
+                UASTForNode *forNode = (UASTForNode*)node;
+                node->left = foldExpression(state, node->left);
+                forNode->cond = foldExpression(state, forNode->cond);
+                forNode->iter = foldExpression(state, forNode->iter);
+                foldAST(state, forNode->block);
+                break;
+            }
+            default: break;
+        }
+
+        /* move to the next statement */
+        node = node->right;
+    }
+}
+
+void UO_foldConstants(UASTRootNode *tree) {
+    UOptState state;
+    state.tree = tree;
+    state.scopes = NULL;
+    state.sCount = 0;
+    state.sCap = 8;
+
+    UM_growarray(UScope*, state.scopes, state.sCount, state.sCap);
+    state.scopes[state.sCount++] = &tree->scope;
+    foldAST(&state, tree->_node.left);
+
+    UM_freearray(state.scopes);
+}
+
+/* ==================================[[ dead code ]]================================== */
+
+UVar *optVar(UOptState *state, UASTNode *node) {
+    UASTVarNode *nVar = (UASTVarNode*)node;
+    return &state->scopes[nVar->scope]->vars[nVar->var];
+}
+
+void enterOptScope(UOptState *state, UScope *scope) {
+    UM_growarray(UScope*, state->scopes, state->sCount, state->sCap);
+    state->scopes[state->sCount++] = scope;
+}
+
+void resetReads(UScope *scope) {
+    int i;
+
+    for (i = 0; i < scope->vCount; i++)
+        scope->vars[i].reads = 0;
+}
+
+/* after folding, a constant condition is always a single literal */
+int isConstCond(UASTNode *node) {
+    return node->type == NODE_INTLIT || node->type == NODE_BOOLLIT || node->type == NODE_CHARLIT;
+}
+
+/* the target of an assignment isn't a read */
+void countReads(UOptState *state, UASTNode *node) {
+    if (node == NULL)
+        return;
+
+    if (node->type == NODE_VAR) {
+        optVar(state, node)->reads++;
+        return;
+    } else if (node->type == NODE_ASSIGN) {
+        countReads(state, node->right);
+        return;
+    }
+
+    countReads(state, node->left);
+    countReads(state, node->right);
+}
+
+void countStatementReads(UOptState *state, UASTNode *node) {
+    while (node) {
+        switch(node->type) {
+            case NODE_STATE_PRNT:
+            case NODE_STATE_EXPR:
+            case NODE_STATE_DECLARE_VAR:
+                countReads(state, node->left);
+                break;
+            case NODE_STATE_SCOPE:
+                resetReads(&((UASTScopeNode*)node)->scope);
+                enterOptScope(state, &((UASTScopeNode*)node)->scope);
+                countStatementReads(state, node->left);
+                state->sCount--;
+                break;
+            case NODE_STATE_IF:
+                countReads(state, node->left);
+                countStatementReads(state, ((UASTIfNode*)node)->block);
+                countStatementReads(state, ((UASTIfNode*)node)->elseBlock);
+                break;
+            case NODE_STATE_WHILE:
+                countReads(state, node->left);
+                countStatementReads(state, ((UASTWhileNode*)node)->block);
+                break;
+            case NODE_STATE_FOR: {
+                UASTForNode *forNode = (UASTForNode*)node;
+                countReads(state, node->left);
+                countReads(state, forNode->cond);
+                countReads(state, forNode->iter);
+                countStatementReads(state, forNode->block);
+                break;
+            }
+            default: break;
+        }
+
+        node = node->right;
+    }
+}
+
+int readsVar(UOptState *state, UASTNode *node, UVar *var) {
+    if (node == NULL)
+        return 0;
+
+    if (node->type == NODE_VAR)
+        return optVar(state, node) == var;
+    else if (node->type == NODE_ASSIGN)
+        return readsVar(state, node->right, var);
+
+    return readsVar(state, node->left, var) || readsVar(state, node->right, var);
+}
+
+/* returns the var the statement stores to if that's all it does with the value, otherwise NULL */
+UVar *storedVar(UOptState *state, UASTNode *node) {
+    if (node->type == NODE_STATE_EXPR && node->left->type == NODE_ASSIGN)
+        return optVar(state, node->left->left);
+    else if (node->type == NODE_STATE_DECLARE_VAR && node->left)
+        return optVar(state, node); /* declarations are var nodes too */
+
+    return NULL;
+}
+
+/* a store is dead if the var is never read, or if it's overwritten before the next read. only the straight-line code
+    after it is searched, anything that branches or opens a scope counts as a read */
+int isDeadStore(UOptState *state, UASTNode *node, UVar *var) {
+    if (var->reads == 0)
+        return 1;
+
+    for (node = node->right; node; node = node->right) {
+        if (node->type != NODE_STATE_EXPR && node->type != NODE_STATE_PRNT && node->type != NODE_STATE_DECLARE_VAR)
+            return 0;
+        if (readsVar(state, node->left, var))
+            return 0;
+        if (storedVar(state, node) == var)
+            return 1;
+    }
+
+    return 0;
+}
+
+UASTNode *dropDeadCode(UOptState *state, UASTNode *node, int *changed);
+
+/* returns what's left of the statement, NULL if nothing is */
+UASTNode *dropDeadStatement(UOptState *state, UASTNode *node, int *changed) {
+    UVar *var;
+
+    switch(node->type) {
+        case NODE_STATE_EXPR:
+            /* keep the side effects of a dead store's value, and drop the rest */
+            if ((var = storedVar(state, node)) && isDeadStore(state, node, var)) {
+                node->left = node->left->right;
+                *changed = 1;
+            }
+            if (isPure(node->left)) {
+                *changed = 1;
+                return NULL;
+            }
+            return node;
+        case NODE_STATE_DECLARE_VAR:
+            if ((var = storedVar(state, node)) && isDeadStore(state, node, var)) {
+                if (isPure(node->left))
+                    node->left = NULL;
+                else
+                    node->type = NODE_STATE_EXPR;
+                *changed = 1;
+            }
+            return node;
+        case NODE_STATE_SCOPE:
+            enterOptScope(state, &((UASTScopeNode*)node)->scope);
+            node->left = dropDeadCode(state, node->left, changed);
+            state->sCount--;
+
+            /* its vars can't be used anywhere else */
+            if (node->left == NULL) {
+                *changed = 1;
+                return NULL;
+            }
+            return node;
+        case NODE_STATE_IF: {
+            UASTIfNode *ifNode = (UASTIfNode*)node;
+            ifNode->block = dropDeadCode(state, ifNode->block, changed);
+            ifNode->elseBlock = dropDeadCode(state, ifNode->elseBlock, changed);
+
+            /* only the arm that's taken is left */
+            if (isConstCond(node->left)) {
+                *changed = 1;
+                return litValue(node->left) ? ifNode->block : ifNode->elseBlock;
+            }
+            if (ifNode->block == NULL && ifNode->elseBlock == NULL && isPure(node->left)) {
+                *changed = 1;
+                return NULL;
+            }
+            return node;
+        }
+        case NODE_STATE_WHILE:
+            if (isConstCond(node->left) && litValue(node->left) == 0) {
+                *changed = 1;
+                return NULL;
+            }
+            ((UASTWhileNode*)node)->block = dropDeadCode(state, ((UASTWhileNode*)node)->block, changed);
+            return node;
+        case NODE_STATE_FOR: {
+            UASTForNode *forNode = (UASTForNode*)node;
+
+            /* the initializer still runs once */
+            if (isConstCond(forNode->cond) && litValue(forNode->cond) == 0) {
+                node->type = NODE_STATE_EXPR;
+                *changed = 1;
+                return isPure(node->left) ? NULL : node;
+            }
+            forNode->block = dropDeadCode(state, forNode->block, changed);
+            return node;
+        }
+        default:
+            return node;
+    }
+}
+
+/* returns the new head of the statement list */
+UASTNode *dropDeadCode(UOptState *state, UASTNode *node, int *changed) {
+    UASTNode *head = NULL, *tail = NULL, *next, *left;
+
+    while (node) {
+        next = node->right;
+        left = dropDeadStatement(state, node, changed);
+
+        if (left) {
+            /* a statement that's kept still points to the old next one, an if that was replaced by its block ends
+                with the block */
+            if (left == node)
+                left->right = NULL;
+
+            if (tail)
+                tail->right = left;
+            else
+                head = left;
+
+            for (tail = left; tail->right; tail = tail->right);
+        }
+
+        node = next;
+    }
+
+    return head;
+}
+
+void UO_eliminateDeadCode(UASTRootNode *tree) {
+    UOptState state;
+    int changed;
+
+    state.tree = tree;
+    state.scopes = NULL;
+    state.sCount = 0;
+    state.sCap = 8;
+
+    /* dropping a store can drop the last read of another var, so repeat until nothing changes */
+    do {
+        changed = 0;
+
+        resetReads(&tree->scope);
+        enterOptScope(&state, &tree->scope);
+        countStatementReads(&state, tree->_node.left);
+        tree->_node.left = dropDeadCode(&state, tree->_node.left, &changed);
+        state.sCount--;
+    } while (changed);
+
+    UM_freearray(state.scopes);
+}
@@ -0,0 +1,14 @@
+#ifndef UOPT_H
+#define UOPT_H
+
+#include "uparse.h"
+
+/* folds constant subtrees & applies algebraic identities (x+0, x*1, x*0, x-x), must be run after US_checkTypes() &
+    before US_resolve() */
+void UO_foldConstants(UASTRootNode *tree);
+
+/* removes branches that are never taken, loops that never run, pure expression statements & stores to vars that are
+    never read (or overwritten first), must be run after UO_foldConstants() & before US_resolve() */
+void UO_eliminateDeadCode(UASTRootNode *tree);
+
+#endif
@@ -26,22 +26,37 @@ ParseRule ruleTable[];
 
 /* ==================================[[ generic helper functions ]]================================== */
 
-void errorAt(UToken *token, const char *fmt, va_list args) {
-    printf("Syntax error at '%.*s' on line %d\n\t", token->len, token->str, token->line);
-    vprintf(fmt, args);
-    printf("\n");
-    exit(EXIT_FAILURE);
+/* frees the parse-time scope stack & symbol tables, the arena is left alone */
+void freeParseState(UParseState *state) {
+    int i;
+
+    for (i = 0; i < state->sCap; i++)
+        UM_freearray(state->scopes[i].vars);
+    UM_freearray(state->scopes);
+    UT_freeInternTable(&state->idents);
+    UT_freeScopeMap(&state->symbols);
+}
+
+void errorAt(UParseState *state, UToken *token, const char *fmt, va_list args) {
+    /* the tree is never handed out, so everything goes before we (maybe) jump back to the caller */
+    freeParseState(state);
+    if (state->arena == &state->ownArena)
+        UM_freeArena(state->arena);
+    else
+        UM_resetArena(state->arena);
+
+    UE_raise(state->err, "Syntax error", token->str, token->len, token->line, fmt, args);
 }
 
 void error(UParseState *state, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    errorAt(&state->previous, fmt, args);
+    errorAt(state, &state->previous, fmt, args);
     va_end(args);
 }
 
 UASTNode *newBaseNode(UParseState *state, UToken tkn, size_t size, UASTNodeType type, UASTNode *left, UASTNode *right) {
-    UASTNode *node = UM_realloc(NULL, size);
+    UASTNode *node = UM_arenaAlloc(state->arena, size);
     node->type = type;
     node->left = left;
     node->right = right;
@@ -60,64 +75,82 @@ UASTNode *newNumNode(UParseState *state, UToken tkn, UASTNode *left, UASTNode *r
     return (UASTNode*)node;
 }
 
-UASTNode *newScopeNode(UParseState *state, UToken tkn, UASTNode *left, UASTNode *right, UScope *scope) {
-    UASTScopeNode *node = (UASTScopeNode*)newBaseNode(state, tkn, sizeof(UASTScopeNode), NODE_STATE_SCOPE, left, right);
-    node->scope = *scope;
-    return (UASTNode*)node;
+UScope* getScope(UParseState *state) {
+    return &state->scopes[state->sCount-1];
 }
 
 UScope* newScope(UParseState *state) {
-    UScope *scope = &state->scopes[state->sCount++];
+    UScope *scope;
 
-    /* sanity check */
-    if (state->sCount >= MAX_SCOPES)
-        error(state, "Max scope limit reached!");
+    /* grow the scope stack, new depths start without a var buffer */
+    if (state->sCount >= state->sCap) {
+        int i, old = state->sCap;
+        state->sCap = old ? old * GROW_FACTOR : 8;
+        state->scopes = (UScope*)UM_realloc(state->scopes, sizeof(UScope) * state->sCap);
+
+        for (i = old; i < state->sCap; i++) {
+            state->scopes[i].vars = NULL;
+            state->scopes[i].vCap = 4;
+        }
+    }
+
+    /* the var buffer of a previous scope at this depth is reused */
+    scope = &state->scopes[state->sCount++];
+    UT_pushScope(&state->symbols);
 
     scope->vCount = 0;
     return scope;
 }
 
-void endScope(UParseState *state) {
-    state->sCount--;
-}
+/* pops the current scope, returning a compact copy of it */
+UScope endScope(UParseState *state) {
+    UScope *scope = getScope(state);
+    UScope sealed;
+
+    sealed.vCount = scope->vCount;
+    sealed.vCap = scope->vCount;
+    sealed.vars = NULL;
+    if (scope->vCount > 0) {
+        sealed.vars = (UVar*)UM_arenaAlloc(state->arena, sizeof(UVar) * scope->vCount);
+        memcpy(sealed.vars, scope->vars, sizeof(UVar) * scope->vCount);
+    }
 
-UScope* getScope(UParseState *state) {
-    return &state->scopes[state->sCount-1];
+    UT_popScope(&state->symbols);
+    state->sCount--;
+    return sealed;
 }
 
 UVar* findVar(UParseState *state, char *name, int length) {
-    int i, z;
-
-    /* walk the scopes and variables */
-    for (i = state->sCount-1; i >= 0; i--) 
-        for (z = state->scopes[i].vCount-1; z >= 0; z--)
-            if (state->scopes[i].vars[z].len == length && !memcmp(state->scopes[i].vars[z].name, name, length))
-                return &state->scopes[i].vars[z];
+    UBinding *bind = UT_lookup(&state->symbols, UT_intern(&state->idents, name, length));
 
     /* var wasn't found */
-    return NULL;
+    if (bind == NULL)
+        return NULL;
+
+    return &state->scopes[bind->scope].vars[bind->index];
 }
 
 int newVar(UParseState *state, UVarType type, char *name, int length) {
     UScope *scope = getScope(state);
-    UVar *var = &scope->vars[scope->vCount++];
+    int sym = UT_intern(&state->idents, name, length);
+    UVar *var;
 
     /* make sure the variable name wasn't already in use */
-    if (findVar(state, name, length) != NULL)
+    if (UT_lookup(&state->symbols, sym) != NULL)
         error(state, "Variable '%.*s' already declared!", length, name);
 
-    /* sanity check */
-    if (scope->vCount >= MAX_LOCALS)
-        error(state, "Max local limit reached, too many locals declared in scope!");
-
     /* set the var and return */
+    UM_growarray(UVar, scope->vars, scope->vCount, scope->vCap);
+    var = &scope->vars[scope->vCount++];
     var->type = type;
     var->name = name;
     var->len = length;
     var->scope = state->sCount-1;
     var->var = scope->vCount-1;
     var->declared = 0;
-    return scope->vCount-1;
+
+    UT_bind(&state->symbols, sym, var->scope, var->var);
+    return var->var;
 }
 
 void advance(UParseState *state) {
@@ -164,6 +197,26 @@ UASTNode* hexnum(UParseState *state, UASTNode *left, Precedence currPrec) {
     return newNumNode(state, state->previous, NULL, NULL, num);
 }
 
+UASTNode* character(UParseState *state, UASTNode *left, Precedence currPrec) {
+    UASTNode *node;
+    char *str = state->previous.str + 1; /* skip the opening ' */
+    int c = str[0];
+
+    /* the lexer already made sure the escape is one it knows */
+    if (c == '\\') {
+        switch(str[1]) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            default: c = '\\'; break;
+        }
+    }
+
+    node = newNumNode(state, state->previous, NULL, NULL, (uint8_t)c);
+    node->type = NODE_CHARLIT;
+    return node;
+}
+
 UASTNode* assignment(UParseState *state, UASTNode *left, Precedence currPrec) {
     UToken tkn = state->previous;
     if (left->type != NODE_VAR)
@@ -195,8 +248,8 @@ UASTNode* binOperator(UParseState *state, UASTNode *left, Precedence currPrec) {
             return NULL;
     }
 
-    /* grab the right node */
-    right = parsePrecedence(state, NULL, currPrec);
+    /* grab the right node, binary operators are left associative so it can't hold another operator of the same level */
+    right = parsePrecedence(state, NULL, (Precedence)(currPrec + 1));
     return newNode(state, tkn, type, left, right);
 }
 
@@ -230,7 +283,7 @@ ParseRule ruleTable[] = {
     {identifer, NULL, PREC_LITERAL}, /* TOKEN_IDENT */
     {number, NULL, PREC_LITERAL}, /* TOKEN_NUMBER */
     {hexnum, NULL, PREC_LITERAL}, /* TOKEN_HEX */
-    {NULL, NULL, PREC_NONE}, /* TOKEN_CHAR_LIT */
+    {character, NULL, PREC_LITERAL}, /* TOKEN_CHAR_LIT */
 
     {NULL, NULL, PREC_NONE}, /* TOKEN_LEFT_BRACE */
     {NULL, NULL, PREC_NONE}, /* TOKEN_RIGHT_BRACE */
@@ -331,13 +384,11 @@ UASTNode* varTypeStatement(UParseState *state, UVarType type) {
 UASTNode* scopeStatement(UParseState *state) {
     UASTScopeNode *node;
     UToken tkn = state->previous;
-    UScope *scope = newScope(state);
+    newScope(state);
 
-    /* create scope node and copy the finished scope struct */
+    /* create scope node and give it the compacted scope */
     node = (UASTScopeNode*)newBaseNode(state, tkn, sizeof(UASTScopeNode), NODE_STATE_SCOPE, parseScope(state, 1), NULL);
-    node->scope = *scope;
-
-    endScope(state);
+    node->scope = endScope(state);
 
     return (UASTNode*)node;
 }
@@ -425,6 +476,8 @@ UASTNode* statement(UParseState *state) {
         node = varTypeStatement(state, TYPE_INT);
     } else if (match(state, TOKEN_BOOL)) {
         node = varTypeStatement(state, TYPE_BOOL);
+    } else if (match(state, TOKEN_CHAR)) {
+        node = varTypeStatement(state, TYPE_CHAR);
     /* the statements below don't require a colon, they directly return skipping that check */
     } else if (match(state, TOKEN_LEFT_BRACE)) {
         return scopeStatement(state);
@@ -461,6 +514,8 @@ void printNode(UASTNode *node) {
         case NODE_NEQUAL: printf("NEQ"); break;
         case NODE_ASSIGN: printf("ASSIGN"); break;
         case NODE_INTLIT: printf("[%d]", ((UASTIntNode*)node)->num); break;
+        case NODE_BOOLLIT: printf("[%s]", ((UASTIntNode*)node)->num ? "true" : "false"); break;
+        case NODE_CHARLIT: printf("['%c']", ((UASTIntNode*)node)->num); break;
         case NODE_TREEROOT: printf("ROOT"); break;
         case NODE_STATE_PRNT: printf("PRNT"); break;
         case NODE_STATE_SCOPE: printf("SCPE"); break;
@@ -495,30 +550,51 @@ const char* getTypeName(UVarType type) {
     }
 }
 
-UASTRootNode *UP_parseSource(const char *src) {
+UASTRootNode *UP_parseSource(const char *src, UArena *arena, UError *err) {
     UParseState state;
     UASTRootNode *root = NULL;
-    UScope *scope;
 
+    if (arena == NULL) {
+        UM_initArena(&state.ownArena, 0);
+        arena = &state.ownArena;
+    }
+
+    state.arena = arena;
+    state.err = err;
+    UT_initInternTable(&state.idents);
+    UT_initScopeMap(&state.symbols);
     UL_initLexState(&state.lstate, src);
-    advance(&state);
+    state.scopes = NULL;
     state.sCount = 0;
-    scope = newScope(&state);
+    state.sCap = 0;
+    advance(&state);
+    newScope(&state);
 
-    /* create scope node and copy the finished scope struct */
+    /* create scope node and give it the compacted scope */
     root = (UASTRootNode*)newBaseNode(&state, state.previous, sizeof(UASTRootNode), NODE_STATE_SCOPE, parseScope(&state, 0), NULL);
-    root->scope = *scope;
+    root->scope = endScope(&state);
+    if (arena == &state.ownArena) {
+        /* the tree now owns the arena */
+        root->ownArena = state.ownArena;
+        root->arena = &root->ownArena;
+    } else {
+        root->arena = arena;
+    }
 
-    endScope(&state);
+    freeParseState(&state);
     /* printTree((UASTNode*)root, 16); */
     return root;
 }
 
-void UP_freeTree(UASTNode *tree) {
-    if (tree->left)
-        UP_freeTree(tree->left);
-    if (tree->right)
-        UP_freeTree(tree->right);
+void UP_freeTree(UASTRootNode *tree) {
+    UArena arena;
+
+    if (tree->arena != &tree->ownArena) {
+        UM_resetArena(tree->arena);
+        return;
+    }
 
-    UM_free(tree);
+    /* the root node lives inside of the arena too, so grab a copy first */
+    arena = tree->ownArena;
+    UM_freeArena(&arena);
 }
\ No newline at end of file
@@ -1,10 +1,10 @@
 #ifndef UPARSE_H
 #define UPARSE_H
 
+#include "umem.h"
 #include "ulex.h"
-
-#define MAX_SCOPES 32
-#define MAX_LOCALS 128
+#include "utable.h"
+#include "uerror.h"
 
 #define COMMON_NODE_HEADER UASTNode _node;
 
@@ -22,6 +22,8 @@ typedef enum {
     NODE_GREATER_EQUAL,
     /* literals */
     NODE_INTLIT,
+    NODE_BOOLLIT, /* only made by the optimizer, uses UASTIntNode */
+    NODE_CHARLIT, /* uses UASTIntNode */
     NODE_VAR,
     NODE_ASSIGN, /* node->left holds Var node, node->right holds expression */
     /* 
@@ -54,11 +56,20 @@ typedef struct {
     int scope;
     int var;
     int declared; /* if the variable can be used yet */
+    int reads; /* scratch for UO_eliminateDeadCode() */
+    /* set by US_resolve() */
+    uint16_t offset; /* offset from the start of the frame */
+    unsigned long uses; /* reads & writes, weighted by loop depth */
+    int zeroPage; /* zero-page slot, or -1 if the var lives in the frame */
 } UVar;
 
 typedef struct {
-    UVar vars[MAX_LOCALS];
+    UVar *vars; /* once the scope is parsed, this is sized to fit and lives in the tree's arena */
     int vCount; /* count of active local variables */
+    int vCap;
+    /* set by US_resolve() */
+    uint16_t base; /* frame offset of the first var */
+    uint16_t size; /* total size of the vars */
 } UScope;
 
 typedef struct s_UASTNode {
@@ -71,6 +82,12 @@ typedef struct s_UASTNode {
 typedef struct {
     COMMON_NODE_HEADER;
     UScope scope;
+    UArena *arena; /* every node in the tree (including this one) lives here */
+    UArena ownArena; /* what arena points to, unless the tree was parsed into the caller's arena */
+    /* set by US_resolve() */
+    uint16_t frameSize; /* size of the deepest frame */
+    UVar **zpVars; /* vars promoted to the zero-page, indexed by slot */
+    int zpCount;
 } UASTRootNode;
 
 typedef struct {
@@ -112,16 +129,26 @@ typedef struct {
     ULexState lstate;
     UToken current;
     UToken previous;
+    /* all nodes are allocated from here */
+    UArena *arena;
+    UArena ownArena; /* used if the caller didn't pass an arena */
+    UError *err;
     /* scopes */
-    UScope scopes[MAX_SCOPES];
+    UScope *scopes;
     int sCount; /* count of active scopes */
+    int sCap;
+    /* identifier lookup */
+    UInternTable idents;
+    UScopeMap symbols; /* symbol id -> declared var */
 } UParseState;
 
 const char* getTypeName(UVarType type);
 
-/* returns the base AST node, or NULL if a syntax error occurred */
-UASTRootNode *UP_parseSource(const char *src);
+/* returns the base AST node, syntax errors are raised through err. if arena isn't NULL the tree is allocated from it
+    (the caller keeps owning it), otherwise the tree gets an arena of its own */
+UASTRootNode *UP_parseSource(const char *src, UArena *arena, UError *err);
 
-void UP_freeTree(UASTNode *tree);
+/* frees the whole tree in one go, a tree parsed into the caller's arena hands its chunks back to it for the next one */
+void UP_freeTree(UASTRootNode *tree);
 
 #endif
\ No newline at end of file
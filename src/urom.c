@@ -0,0 +1,366 @@
+#include "urom.h"
+
+#define MAX_WORD 64
+
+/* opcodes in encoding order, the mode bits (0x20 short, 0x40 return, 0x80 keep) are or'd on top */
+static const char *opcodeNames[] = {
+    "LIT", "INC", "POP", "NIP", "SWP", "ROT", "DUP", "OVR",
+    "EQU", "NEQ", "GTH", "LTH", "JMP", "JCN", "JSR", "STH",
+    "LDZ", "STZ", "LDR", "STR", "LDA", "STA", "DEI", "DEO",
+    "ADD", "SUB", "MUL", "DIV", "AND", "ORA", "EOR", "SFT"
+};
+
+typedef struct {
+    URom *rom;
+    const char *src;
+    int pass; /* 1 = collect labels, 2 = write bytes */
+    int ptr;
+    char scope[MAX_WORD];
+} UAsmState;
+
+/* ==================================[[ generic helper functions ]]================================== */
+
+int asmError(UAsmState *state, const char *fmt, const char *word, int len) {
+    if (len > MAX_WORD)
+        len = MAX_WORD;
+
+    sprintf(state->rom->err, fmt, len, word);
+    return 0;
+}
+
+int isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/* returns the value of a hex string, or -1 if it isn't one */
+long parseHex(const char *str, int len) {
+    long val = 0;
+    int i;
+
+    if (len == 0)
+        return -1;
+
+    for (i = 0; i < len; i++) {
+        char c = str[i];
+        val <<= 4;
+        if (c >= '0' && c <= '9') val |= c - '0';
+        else if (c >= 'a' && c <= 'f') val |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') val |= c - 'A' + 10;
+        else return -1;
+    }
+
+    return val;
+}
+
+/* returns the encoded opcode, or -1 if the word isn't one */
+int findOpcode(const char *word, int len) {
+    int i, op = -1;
+
+    if (len == 3 && !memcmp(word, "BRK", 3))
+        return 0x00;
+
+    if (len < 3)
+        return -1;
+
+    for (i = 0; i < 32; i++) {
+        if (!memcmp(word, opcodeNames[i], 3)) {
+            op = i;
+            break;
+        }
+    }
+
+    if (op == -1)
+        return -1;
+
+    /* LIT is always in keep mode */
+    if (op == 0)
+        op |= 0x80;
+
+    /* parse the modes */
+    for (i = 3; i < len; i++) {
+        switch (word[i]) {
+            case '2': op |= 0x20; break;
+            case 'r': op |= 0x40; break;
+            case 'k': op |= 0x80; break;
+            default: return -1;
+        }
+    }
+
+    return op;
+}
+
+/* builds the full label name, sub-labels (starting with '&') are relative to the current scope */
+int fullName(UAsmState *state, char *out, const char *word, int len) {
+    if (len > 0 && word[0] == '&') {
+        int sLen = strlen(state->scope);
+        if (sLen + len >= MAX_WORD)
+            return asmError(state, "Label '%.*s' is too long!", word, len);
+
+        memcpy(out, state->scope, sLen);
+        out[sLen] = '/';
+        memcpy(out + sLen + 1, word + 1, len - 1);
+        out[sLen + len] = '\0';
+        return sLen + len;
+    }
+
+    if (len >= MAX_WORD)
+        return asmError(state, "Label '%.*s' is too long!", word, len);
+
+    memcpy(out, word, len);
+    out[len] = '\0';
+    return len;
+}
+
+ULabel *getLabel(URom *rom, const char *name, int len) {
+    int id;
+    char *str;
+
+    /* the intern table keeps the pointer, so new names are copied into the arena */
+    if ((id = UT_find(&rom->names, name, len)) == -1) {
+        str = (char*)UM_arenaAlloc(&rom->strings, len + 1);
+        memcpy(str, name, len);
+        id = UT_intern(&rom->names, str, len);
+    }
+
+    if (id >= rom->lCap) {
+        int old = rom->lCap, i;
+        rom->lCap = rom->lCap ? rom->lCap : 64;
+        while (id >= rom->lCap)
+            rom->lCap *= GROW_FACTOR;
+        rom->labels = (ULabel*)UM_realloc(rom->labels, sizeof(ULabel) * rom->lCap);
+
+        for (i = old; i < rom->lCap; i++)
+            rom->labels[i].defined = 0;
+    }
+
+    return &rom->labels[id];
+}
+
+int defineLabel(UAsmState *state, const char *word, int len) {
+    char name[MAX_WORD];
+    ULabel *lbl;
+
+    if (!(len = fullName(state, name, word, len)))
+        return 0;
+
+    /* labels are only defined in the first pass */
+    if (state->pass == 2)
+        return 1;
+
+    lbl = getLabel(state->rom, name, len);
+    if (lbl->defined)
+        return asmError(state, "Duplicate label '%.*s'!", name, len);
+
+    lbl->defined = 1;
+    lbl->addr = state->ptr;
+    return 1;
+}
+
+/* returns the address of a referenced label, or -1 if it couldn't be resolved */
+long resolveLabel(UAsmState *state, const char *word, int len) {
+    char name[MAX_WORD];
+    ULabel *lbl;
+
+    /* the first pass only needs sizes */
+    if (state->pass == 1)
+        return 0;
+
+    if (!(len = fullName(state, name, word, len)))
+        return -1;
+
+    lbl = getLabel(state->rom, name, len);
+    if (!lbl->defined) {
+        asmError(state, "Unknown label '%.*s'!", name, len);
+        return -1;
+    }
+
+    return lbl->addr;
+}
+
+int writeByte(UAsmState *state, int byte) {
+    if (state->ptr < ROM_START)
+        return asmError(state, "Writing in zero-page!", NULL, 0);
+    if (state->ptr >= ROM_MEMORY)
+        return asmError(state, "Writing past the end of memory!", NULL, 0);
+
+    if (state->pass == 2) {
+        state->rom->data[state->ptr] = (uint8_t)byte;
+        if (state->ptr + 1 > state->rom->length)
+            state->rom->length = state->ptr + 1;
+    }
+
+    state->ptr++;
+    return 1;
+}
+
+int writeShort(UAsmState *state, int val) {
+    return writeByte(state, (val >> 8) & 0xFF) && writeByte(state, val & 0xFF);
+}
+
+/* ==================================[[ assembler ]]================================== */
+
+int assembleWord(UAsmState *state, const char *word, int len) {
+    long val;
+    int op, i;
+
+    switch (word[0]) {
+        case '|': /* absolute padding */
+            if ((val = parseHex(word + 1, len - 1)) == -1)
+                return asmError(state, "Invalid padding '%.*s'!", word, len);
+            state->ptr = val;
+            return 1;
+        case '$': /* relative padding */
+            if ((val = parseHex(word + 1, len - 1)) == -1)
+                return asmError(state, "Invalid padding '%.*s'!", word, len);
+            state->ptr += val;
+            return 1;
+        case '@': /* label, also starts a new scope */
+            if (len - 1 >= MAX_WORD)
+                return asmError(state, "Label '%.*s' is too long!", word, len);
+            memcpy(state->scope, word + 1, len - 1);
+            state->scope[len - 1] = '\0';
+            return defineLabel(state, word + 1, len - 1);
+        case '&': /* sub-label */
+            return defineLabel(state, word, len);
+        case '#': /* literal hex */
+            val = parseHex(word + 1, len - 1);
+            if (val == -1 || (len != 3 && len != 5))
+                return asmError(state, "Invalid literal '%.*s'!", word, len);
+            if (len == 3)
+                return writeByte(state, 0x80) && writeByte(state, val);
+            return writeByte(state, 0xa0) && writeShort(state, val);
+        case '\'': /* raw character */
+            if (len != 2)
+                return asmError(state, "Invalid character '%.*s'!", word, len);
+            return writeByte(state, word[1]);
+        case '"': /* raw string */
+            for (i = 1; i < len; i++)
+                if (!writeByte(state, word[i]))
+                    return 0;
+            return 1;
+        case '.': /* literal zero-page address */
+            if ((val = resolveLabel(state, word + 1, len - 1)) == -1)
+                return 0;
+            return writeByte(state, 0x80) && writeByte(state, val & 0xFF);
+        case ',': /* literal relative address */
+            if ((val = resolveLabel(state, word + 1, len - 1)) == -1)
+                return 0;
+            if (state->pass == 2) {
+                val -= state->ptr + 3; /* relative to the end of the instruction using it */
+                if (val < -128 || val > 127)
+                    return asmError(state, "Relative reference '%.*s' is too far!", word, len);
+            }
+            return writeByte(state, 0x80) && writeByte(state, val & 0xFF);
+        case ';': /* literal absolute address */
+            if ((val = resolveLabel(state, word + 1, len - 1)) == -1)
+                return 0;
+            return writeByte(state, 0xa0) && writeShort(state, val);
+        case ':': /* raw absolute address */
+            if ((val = resolveLabel(state, word + 1, len - 1)) == -1)
+                return 0;
+            return writeShort(state, val);
+        case '[': case ']':
+            if (len == 1)
+                return 1;
+            break;
+        default: break;
+    }
+
+    if ((op = findOpcode(word, len)) != -1)
+        return writeByte(state, op);
+
+    /* raw hex bytes */
+    if ((len == 2 || len == 4) && (val = parseHex(word, len)) != -1)
+        return len == 2 ? writeByte(state, val) : writeShort(state, val);
+
+    return asmError(state, "Unknown token '%.*s'!", word, len);
+}
+
+int assemblePass(UAsmState *state) {
+    const char *current = state->src;
+    int comment = 0;
+
+    state->ptr = 0;
+    state->scope[0] = '\0';
+
+    while (*current) {
+        const char *word;
+        int len;
+
+        /* skip to the start of the next word */
+        while (*current && isSpace(*current))
+            current++;
+
+        word = current;
+        while (*current && !isSpace(*current))
+            current++;
+
+        if ((len = current - word) == 0)
+            break;
+
+        /* comments are skipped, they can nest */
+        if (len == 1 && word[0] == '(') {
+            comment++;
+            continue;
+        } else if (len == 1 && word[0] == ')') {
+            comment--;
+            continue;
+        } else if (comment > 0) {
+            continue;
+        }
+
+        if (!assembleWord(state, word, len))
+            return 0;
+    }
+
+    return 1;
+}
+
+void UR_initRom(URom *rom) {
+    memset(rom->data, 0, sizeof(rom->data));
+    rom->length = 0;
+    rom->labels = NULL;
+    rom->lCap = 0;
+    rom->err[0] = '\0';
+    UT_initInternTable(&rom->names);
+    UM_initArena(&rom->strings, 0);
+}
+
+void UR_freeRom(URom *rom) {
+    UT_freeInternTable(&rom->names);
+    UM_freearray(rom->labels);
+    UM_freeArena(&rom->strings);
+}
+
+int UR_assemble(URom *rom, const char *src) {
+    UAsmState state;
+    state.rom = rom;
+    state.src = src;
+
+    /* first pass collects the labels, second pass writes the bytes */
+    for (state.pass = 1; state.pass <= 2; state.pass++)
+        if (!assemblePass(&state))
+            return 0;
+
+    return 1;
+}
+
+void UR_defineLabel(URom *rom, const char *name, int len, uint16_t addr) {
+    ULabel *lbl = getLabel(rom, name, len);
+    lbl->defined = 1;
+    lbl->addr = addr;
+}
+
+int UR_findLabel(URom *rom, const char *name) {
+    ULabel *lbl = getLabel(rom, name, strlen(name));
+    return lbl->defined ? lbl->addr : -1;
+}
+
+int UR_romSize(URom *rom) {
+    return rom->length > ROM_START ? rom->length - ROM_START : 0;
+}
+
+int UR_writeRom(URom *rom, FILE *out) {
+    int size = UR_romSize(rom);
+    return fwrite(rom->data + ROM_START, 1, size, out) == (size_t)size;
+}
@@ -0,0 +1,46 @@
+#ifndef UROM_H
+#define UROM_H
+
+#include "uxncle.h"
+#include "umem.h"
+#include "utable.h"
+
+/* roms are loaded here, everything before it is zero-page & the stacks */
+#define ROM_START 0x0100
+#define ROM_MEMORY 0x10000
+
+typedef struct {
+    uint16_t addr;
+    int defined;
+} ULabel;
+
+typedef struct {
+    uint8_t data[ROM_MEMORY]; /* the whole address space, only ROM_START up to length ends up in the rom */
+    int length; /* last written address + 1 */
+    /* labels, indexed by their interned symbol id */
+    UInternTable names;
+    ULabel *labels;
+    int lCap;
+    UArena strings; /* full label names ("scope/sub") live here */
+    char err[128];
+} URom;
+
+void UR_initRom(URom *rom);
+void UR_freeRom(URom *rom);
+
+/* assembles the uxntal source, returns 0 and sets rom->err if an error occurred */
+int UR_assemble(URom *rom, const char *src);
+
+/* defines a label without assembling anything, for roms that are loaded with their labels (see UC_compileRom()) */
+void UR_defineLabel(URom *rom, const char *name, int len, uint16_t addr);
+
+/* returns the address of a label, or -1 if it wasn't defined */
+int UR_findLabel(URom *rom, const char *name);
+
+/* writes the assembled rom (ROM_START up to length) */
+int UR_writeRom(URom *rom, FILE *out);
+
+/* returns the size of the assembled rom in bytes */
+int UR_romSize(URom *rom);
+
+#endif
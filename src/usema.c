@@ -0,0 +1,424 @@
+#include "umem.h"
+#include "usema.h"
+#include "uasm.h"
+
+/* uses inside of loops count this many times more per level of nesting (as a shift) */
+#define LOOP_WEIGHT_SHIFT 3
+#define MAX_LOOP_WEIGHT 8
+
+typedef struct {
+    UVar *var;
+    int seq; /* declaration order, keeps the zero-page pick deterministic */
+} UVarRef;
+
+/* semantic analysis state */
+typedef struct {
+    UASTRootNode *tree;
+    UOptions *opts;
+    UError *err;
+    UScope **scopes; /* stack of active scopes */
+    int sCount;
+    int sCap;
+    UVarRef *vars; /* every var in the tree */
+    int vCount;
+    int vCap;
+    int loopDepth;
+} USemaState;
+
+void resolveAST(USemaState *state, UASTNode *node, uint16_t frameTop);
+void countAST(USemaState *state, UASTNode *node);
+
+/* ==================================[[ generic helper functions ]]================================== */
+
+void semaErrorNode(USemaState *state, UASTNode *node, const char *fmt, ...) {
+    va_list args;
+
+    /* the tree belongs to the caller, only our own scratch is freed */
+    UM_freearray(state->scopes);
+    UM_freearray(state->vars);
+
+    va_start(args, fmt);
+    UE_raise(state->err, "Compiler error", node->tkn.str, node->tkn.len, node->tkn.line, fmt, args);
+    va_end(args);
+}
+
+uint16_t typeSize(UVarType type) {
+    switch(type) {
+        case TYPE_CHAR: return SIZE_CHAR;
+        case TYPE_BOOL: return SIZE_BOOL;
+        case TYPE_INT: return SIZE_INT;
+        default:
+            return 0;
+    }
+}
+
+/* ==================================[[ use counting ]]================================== */
+
+void enterScope(USemaState *state, UScope *scope) {
+    int i;
+
+    UM_growarray(UScope*, state->scopes, state->sCount, state->sCap);
+    state->scopes[state->sCount++] = scope;
+
+    /* remember every var we come across */
+    for (i = 0; i < scope->vCount; i++) {
+        UM_growarray(UVarRef, state->vars, state->vCount, state->vCap);
+        state->vars[state->vCount].var = &scope->vars[i];
+        state->vars[state->vCount].seq = state->vCount;
+        state->vCount++;
+
+        scope->vars[i].uses = 0;
+        scope->vars[i].zeroPage = -1;
+    }
+}
+
+void leaveScope(USemaState *state) {
+    state->sCount--;
+}
+
+void addUse(USemaState *state, UASTNode *node) {
+    UASTVarNode *nVar = (UASTVarNode*)node;
+    int depth = state->loopDepth < MAX_LOOP_WEIGHT ? state->loopDepth : MAX_LOOP_WEIGHT;
+
+    state->scopes[nVar->scope]->vars[nVar->var].uses += 1UL << (depth * LOOP_WEIGHT_SHIFT);
+}
+
+void countExpression(USemaState *state, UASTNode *node) {
+    if (node == NULL)
+        return;
+
+    /* both reads & writes count as a use */
+    if (node->type == NODE_VAR) {
+        addUse(state, node);
+        return;
+    }
+
+    countExpression(state, node->left);
+    countExpression(state, node->right);
+}
+
+void countAST(USemaState *state, UASTNode *node) {
+    while (node) {
+        switch(node->type) {
+            case NODE_STATE_PRNT:
+            case NODE_STATE_EXPR:
+                countExpression(state, node->left);
+                break;
+            case NODE_STATE_DECLARE_VAR:
+                if (node->left) {
+                    countExpression(state, node->left);
+                    addUse(state, node); /* the initializing store */
+                }
+                break;
+            case NODE_STATE_SCOPE:
+                enterScope(state, &((UASTScopeNode*)node)->scope);
+                countAST(state, node->left);
+                leaveScope(state);
+                break;
+            case NODE_STATE_IF:
+                countExpression(state, node->left);
+                countAST(state, ((UASTIfNode*)node)->block);
+                countAST(state, ((UASTIfNode*)node)->elseBlock);
+                break;
+            case NODE_STATE_WHILE:
+                state->loopDepth++;
+                countExpression(state, node->left);
+                countAST(state, ((UASTWhileNode*)node)->block);
+                state->loopDepth--;
+                break;
+            case NODE_STATE_FOR:
+                countExpression(state, node->left); /* the initializer only runs once */
+                state->loopDepth++;
+                countExpression(state, ((UASTForNode*)node)->cond);
+                countExpression(state, ((UASTForNode*)node)->iter);
+                countAST(state, ((UASTForNode*)node)->block);
+                state->loopDepth--;
+                break;
+            default: break;
+        }
+
+        /* move to the next statement */
+        node = node->right;
+    }
+}
+
+/* ==================================[[ zero-page promotion ]]================================== */
+
+int compareUses(const void *a, const void *b) {
+    const UVarRef *v1 = (const UVarRef*)a, *v2 = (const UVarRef*)b;
+
+    if (v1->var->uses != v2->var->uses)
+        return v1->var->uses > v2->var->uses ? -1 : 1;
+
+    return v1->seq - v2->seq;
+}
+
+/* gives the most used vars a zero-page slot until it's full */
+void promoteVars(USemaState *state) {
+    UASTRootNode *tree = state->tree;
+    int i, used = 0;
+
+    qsort(state->vars, state->vCount, sizeof(UVarRef), compareUses);
+
+    tree->zpVars = (UVar**)UM_arenaAlloc(tree->arena, sizeof(UVar*) * (state->vCount ? state->vCount : 1));
+    for (i = 0; i < state->vCount; i++) {
+        UVar *var = state->vars[i].var;
+        int size = typeSize(var->type);
+
+        if (var->uses == 0 || used + size > ZERO_PAGE_SPACE)
+            continue;
+
+        var->zeroPage = tree->zpCount;
+        tree->zpVars[tree->zpCount++] = var;
+        used += size;
+    }
+}
+
+/* ==================================[[ frame layout ]]================================== */
+
+/* lays out the scope's vars starting at base, promoted vars (and with opts->deadCode, vars nothing refers to anymore)
+    don't take up any room in the frame */
+void resolveScope(USemaState *state, UASTNode *node, UScope *scope, uint16_t base) {
+    unsigned long offset = base;
+    int i;
+
+    scope->base = base;
+    for (i = 0; i < scope->vCount; i++) {
+        scope->vars[i].offset = (uint16_t)offset;
+        if (scope->vars[i].zeroPage == -1 && (scope->vars[i].uses > 0 || !state->opts->deadCode))
+            offset += typeSize(scope->vars[i].type);
+    }
+
+    /* the one place we check the frame actually fits */
+    if (offset > HEAP_SPACE)
+        semaErrorNode(state, node, "Frame is too big! (%lu bytes, max is %d)", offset, HEAP_SPACE);
+
+    scope->size = (uint16_t)(offset - base);
+    if (offset > state->tree->frameSize)
+        state->tree->frameSize = (uint16_t)offset;
+}
+
+void resolveAST(USemaState *state, UASTNode *node, uint16_t frameTop) {
+    /* STATE nodes hold the expression in node->left, and the next statement in node->right */
+    while (node) {
+        switch(node->type) {
+            case NODE_STATE_SCOPE: {
+                UScope *scope = &((UASTScopeNode*)node)->scope;
+                resolveScope(state, node, scope, frameTop);
+                resolveAST(state, node->left, scope->base + scope->size);
+                break;
+            }
+            case NODE_STATE_IF:
+                resolveAST(state, ((UASTIfNode*)node)->block, frameTop);
+                resolveAST(state, ((UASTIfNode*)node)->elseBlock, frameTop);
+                break;
+            case NODE_STATE_WHILE: resolveAST(state, ((UASTWhileNode*)node)->block, frameTop); break;
+            case NODE_STATE_FOR: resolveAST(state, ((UASTForNode*)node)->block, frameTop); break;
+            default: break;
+        }
+
+        /* move to the next statement */
+        node = node->right;
+    }
+}
+
+/* ==================================[[ type checking ]]================================== */
+
+/* these follow the codegen's rules in uasm.c (see operandType() & compileTyped()), the codegen still checks as it goes
+    but by then the optimizer may have removed code, so this is where a program is accepted or rejected */
+
+UVarType checkExpression(USemaState *state, UASTNode *node);
+
+UVarType varType(USemaState *state, UASTNode *node) {
+    UASTVarNode *nVar = (UASTVarNode*)node;
+    return state->scopes[nVar->scope]->vars[nVar->var].type;
+}
+
+int isLitExpr(UASTNode *node) {
+    return node->type == NODE_INTLIT || node->type == NODE_CHARLIT;
+}
+
+int isByteLitExpr(UASTNode *node) {
+    return node->type == NODE_INTLIT && (((UASTIntNode*)node)->num & 0xffff) <= 0xff;
+}
+
+/* char, bool & int can all be cast to one another */
+int castable(UVarType from, UVarType to) {
+    return from == to || (typeSize(from) && typeSize(to));
+}
+
+/* the type the expression ends up as when it's compiled where `want` is expected, literals are written at that width
+    & chars are widened to ints */
+UVarType coerceType(UASTNode *node, UVarType type, UVarType want) {
+    if (want == TYPE_CHAR && (isByteLitExpr(node) || node->type == NODE_CHARLIT))
+        return TYPE_CHAR;
+    if (want == TYPE_INT && node->type == NODE_CHARLIT)
+        return TYPE_INT;
+    if (want == TYPE_BOOL && isLitExpr(node))
+        return TYPE_BOOL;
+    if (type == TYPE_CHAR && want == TYPE_INT)
+        return TYPE_INT;
+
+    return type;
+}
+
+/* both sides of a binary operator have to end up the same type, returns it */
+UVarType checkOperands(USemaState *state, UASTNode *node) {
+    UVarType lType = checkExpression(state, node->left), rType = checkExpression(state, node->right), want = lType;
+
+    /* a byte sized int literal takes the type of a char on the other side, otherwise a char next to an int is widened */
+    if ((lType == TYPE_CHAR && isByteLitExpr(node->right)) || (rType == TYPE_CHAR && isByteLitExpr(node->left)))
+        want = TYPE_CHAR;
+    else if ((lType == TYPE_CHAR && rType == TYPE_INT) || (lType == TYPE_INT && rType == TYPE_CHAR))
+        want = TYPE_INT;
+
+    lType = coerceType(node->left, lType, want);
+    rType = coerceType(node->right, rType, want);
+    if (lType != rType)
+        semaErrorNode(state, node, "lType '%s' doesn't match rType '%s'!", getTypeName(lType), getTypeName(rType));
+
+    return lType;
+}
+
+UVarType checkExpression(USemaState *state, UASTNode *node) {
+    UVarType type;
+
+    switch(node->type) {
+        case NODE_ASSIGN: {
+            UASTVarNode *nVar = (UASTVarNode*)node->left;
+            UVar *rawVar = &state->scopes[nVar->scope]->vars[nVar->var];
+
+            type = coerceType(node->right, checkExpression(state, node->right), rawVar->type);
+            if (!castable(type, rawVar->type))
+                semaErrorNode(state, node, "Cannot assign type '%s' to '%.*s' of type '%s'", getTypeName(type), rawVar->len, rawVar->name, getTypeName(rawVar->type));
+            return rawVar->type;
+        }
+        case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV:
+            type = checkOperands(state, node);
+            if (type != TYPE_INT && type != TYPE_CHAR)
+                semaErrorNode(state, node, "Cannot do arithmetic on type '%s'", getTypeName(type));
+            return type;
+        case NODE_LESS: case NODE_GREATER: case NODE_EQUAL: case NODE_NEQUAL:
+        case NODE_LESS_EQUAL: case NODE_GREATER_EQUAL:
+            checkOperands(state, node);
+            return TYPE_BOOL;
+        case NODE_INTLIT: return TYPE_INT;
+        case NODE_CHARLIT: return TYPE_CHAR;
+        case NODE_BOOLLIT: return TYPE_BOOL;
+        case NODE_VAR: return varType(state, node);
+        default:
+            semaErrorNode(state, node, "unknown AST node!! [%d]\n", node->type);
+            return TYPE_NONE;
+    }
+}
+
+void checkCondition(USemaState *state, UASTNode *node) {
+    UVarType type = checkExpression(state, node);
+
+    if (!castable(type, TYPE_BOOL))
+        semaErrorNode(state, node, "Cannot cast type '%s' to type '%s'", getTypeName(type), getTypeName(TYPE_BOOL));
+}
+
+/* statements are checked in the order the codegen compiles them, so the same error is reported first */
+void checkAST(USemaState *state, UASTNode *node) {
+    UVarType type;
+
+    while (node) {
+        switch(node->type) {
+            case NODE_STATE_PRNT:
+                type = coerceType(node->left, checkExpression(state, node->left), TYPE_INT);
+                if (!castable(type, TYPE_INT))
+                    semaErrorNode(state, node->left, "Cannot cast type '%s' to type '%s'", getTypeName(type), getTypeName(TYPE_INT));
+                break;
+            case NODE_STATE_DECLARE_VAR:
+                if (node->left) {
+                    UVar *rawVar = &state->scopes[((UASTVarNode*)node)->scope]->vars[((UASTVarNode*)node)->var];
+
+                    type = coerceType(node->left, checkExpression(state, node->left), rawVar->type);
+                    if (!castable(type, rawVar->type))
+                        semaErrorNode(state, node, "Cannot assign type '%s' to %.*s of type '%s'", getTypeName(type), rawVar->len, rawVar->name, getTypeName(rawVar->type));
+                }
+                break;
+            case NODE_STATE_EXPR: checkExpression(state, node->left); break;
+            case NODE_STATE_SCOPE:
+                UM_growarray(UScope*, state->scopes, state->sCount, state->sCap);
+                state->scopes[state->sCount++] = &((UASTScopeNode*)node)->scope;
+                checkAST(state, node->left);
+                state->sCount--;
+                break;
+            case NODE_STATE_IF:
+                checkCondition(state, node->left);
+                checkAST(state, ((UASTIfNode*)node)->elseBlock);
+                checkAST(state, ((UASTIfNode*)node)->block);
+                break;
+            case NODE_STATE_WHILE:
+                checkAST(state, ((UASTWhileNode*)node)->block);
+                checkCondition(state, node->left);
+                break;
+            case NODE_STATE_FOR:
+                checkExpression(state, node->left);
+                checkAST(state, ((UASTForNode*)node)->block);
+                checkExpression(state, ((UASTForNode*)node)->iter);
+                checkCondition(state, ((UASTForNode*)node)->cond);
+                break;
+            default:
+                semaErrorNode(state, node, "unknown statement node!! [%d]\n", node->type);
+        }
+
+        /* move to the next statement */
+        node = node->right;
+    }
+}
+
+void US_checkTypes(UASTRootNode *tree, UError *err) {
+    USemaState state;
+    state.tree = tree;
+    state.opts = NULL;
+    state.err = err;
+    state.scopes = NULL;
+    state.sCount = 0;
+    state.sCap = 8;
+    state.vars = NULL;
+    state.vCount = 0;
+    state.vCap = 8;
+    state.loopDepth = 0;
+
+    UM_growarray(UScope*, state.scopes, state.sCount, state.sCap);
+    state.scopes[state.sCount++] = &tree->scope;
+    checkAST(&state, tree->_node.left);
+
+    UM_freearray(state.scopes);
+}
+
+void US_resolve(UASTRootNode *tree, UOptions *opts, UError *err) {
+    USemaState state;
+    state.tree = tree;
+    state.opts = opts;
+    state.err = err;
+    state.scopes = NULL;
+    state.sCount = 0;
+    state.sCap = 8;
+    state.vars = NULL;
+    state.vCount = 0;
+    state.vCap = 8;
+    state.loopDepth = 0;
+
+    tree->frameSize = 0;
+    tree->zpVars = NULL;
+    tree->zpCount = 0;
+
+    /* count how hot each var is */
+    enterScope(&state, &tree->scope);
+    countAST(&state, tree->_node.left);
+    leaveScope(&state);
+
+    if (opts->zeroPage)
+        promoteVars(&state);
+
+    /* lay out the frame */
+    resolveScope(&state, (UASTNode*)tree, &tree->scope, 0);
+    resolveAST(&state, tree->_node.left, tree->scope.size);
+
+    UM_freearray(state.scopes);
+    UM_freearray(state.vars);
+}
@@ -0,0 +1,14 @@
+#ifndef USEMA_H
+#define USEMA_H
+
+#include "uparse.h"
+
+/* walks the tree assigning every UVar its frame offset (or a zero-page slot, if opts->zeroPage is set) and every
+    scope its base & size, must be run before UA_genTal. errors are raised through err */
+void US_resolve(UASTRootNode *tree, UOptions *opts, UError *err);
+
+/* raises a compiler error through err if any expression in the tree is the wrong type. must be run before the
+    optimizer, which can remove code, so a program is accepted or rejected the same way with or without it */
+void US_checkTypes(UASTRootNode *tree, UError *err);
+
+#endif
@@ -0,0 +1,163 @@
+#include "umem.h"
+#include "utable.h"
+
+#define INTERN_START_CAP 64
+#define MAP_START_CAP 16
+
+/* ==================================[[ identifier interning ]]================================== */
+
+/* FNV-1a */
+uint32_t hashString(const char *str, int len) {
+    uint32_t hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void UT_initInternTable(UInternTable *tbl) {
+    tbl->syms = NULL;
+    tbl->sCount = 0;
+    tbl->sCap = INTERN_START_CAP;
+    tbl->slotCap = INTERN_START_CAP;
+    tbl->slots = (int*)UM_realloc(NULL, sizeof(int) * tbl->slotCap);
+    memset(tbl->slots, 0, sizeof(int) * tbl->slotCap);
+}
+
+void UT_freeInternTable(UInternTable *tbl) {
+    UM_freearray(tbl->syms);
+    UM_freearray(tbl->slots);
+}
+
+/* doubles the slot array and reinserts every symbol */
+void growSlots(UInternTable *tbl) {
+    int i, slot, mask;
+
+    UM_freearray(tbl->slots);
+    tbl->slotCap *= GROW_FACTOR;
+    tbl->slots = (int*)UM_realloc(NULL, sizeof(int) * tbl->slotCap);
+    memset(tbl->slots, 0, sizeof(int) * tbl->slotCap);
+
+    mask = tbl->slotCap - 1;
+    for (i = 0; i < tbl->sCount; i++) {
+        slot = tbl->syms[i].hash & mask;
+        while (tbl->slots[slot] != 0)
+            slot = (slot + 1) & mask;
+        tbl->slots[slot] = i + 1;
+    }
+}
+
+int UT_find(UInternTable *tbl, const char *str, int len) {
+    uint32_t hash = hashString(str, len);
+    int mask = tbl->slotCap - 1;
+    int slot = hash & mask;
+    USymbol *sym;
+
+    while (tbl->slots[slot] != 0) {
+        sym = &tbl->syms[tbl->slots[slot] - 1];
+        if (sym->hash == hash && sym->len == len && !memcmp(sym->str, str, len))
+            return tbl->slots[slot] - 1;
+        slot = (slot + 1) & mask;
+    }
+
+    return -1;
+}
+
+int UT_intern(UInternTable *tbl, char *str, int len) {
+    uint32_t hash = hashString(str, len);
+    int mask = tbl->slotCap - 1;
+    int slot = hash & mask;
+    USymbol *sym;
+
+    /* linear probe until we find the symbol or an empty slot */
+    while (tbl->slots[slot] != 0) {
+        sym = &tbl->syms[tbl->slots[slot] - 1];
+        if (sym->hash == hash && sym->len == len && !memcmp(sym->str, str, len))
+            return tbl->slots[slot] - 1;
+        slot = (slot + 1) & mask;
+    }
+
+    /* it's a new symbol */
+    UM_growarray(USymbol, tbl->syms, tbl->sCount, tbl->sCap);
+    sym = &tbl->syms[tbl->sCount];
+    sym->str = str;
+    sym->len = len;
+    sym->hash = hash;
+    tbl->slots[slot] = ++tbl->sCount;
+
+    /* keep the load factor under 1/2 */
+    if (tbl->sCount * 2 > tbl->slotCap)
+        growSlots(tbl);
+
+    return tbl->sCount - 1;
+}
+
+/* ==================================[[ scoped symbol map ]]================================== */
+
+void UT_initScopeMap(UScopeMap *map) {
+    map->bindings = NULL;
+    map->bCap = 0;
+    map->log = NULL;
+    map->lCount = 0;
+    map->lCap = MAP_START_CAP;
+    map->marks = NULL;
+    map->mCount = 0;
+    map->mCap = MAP_START_CAP;
+}
+
+void UT_freeScopeMap(UScopeMap *map) {
+    UM_freearray(map->bindings);
+    UM_freearray(map->log);
+    UM_freearray(map->marks);
+}
+
+void UT_pushScope(UScopeMap *map) {
+    UM_growarray(int, map->marks, map->mCount, map->mCap);
+    map->marks[map->mCount++] = map->lCount;
+}
+
+void UT_popScope(UScopeMap *map) {
+    int mark = map->marks[--map->mCount];
+
+    /* undo the bindings in reverse order */
+    while (map->lCount > mark) {
+        UBindingUndo *undo = &map->log[--map->lCount];
+        map->bindings[undo->sym] = undo->prev;
+    }
+}
+
+UBinding *UT_lookup(UScopeMap *map, int sym) {
+    if (sym >= map->bCap || map->bindings[sym].scope == -1)
+        return NULL;
+
+    return &map->bindings[sym];
+}
+
+void UT_bind(UScopeMap *map, int sym, int scope, int index) {
+    UBindingUndo *undo;
+
+    /* grow the binding array to fit the symbol id */
+    if (sym >= map->bCap) {
+        int old = map->bCap, i;
+        map->bCap = map->bCap ? map->bCap : MAP_START_CAP;
+        while (sym >= map->bCap)
+            map->bCap *= GROW_FACTOR;
+        map->bindings = (UBinding*)UM_realloc(map->bindings, sizeof(UBinding) * map->bCap);
+
+        for (i = old; i < map->bCap; i++)
+            map->bindings[i].scope = -1;
+    }
+
+    /* remember the old binding so UT_popScope can restore it */
+    UM_growarray(UBindingUndo, map->log, map->lCount, map->lCap);
+    undo = &map->log[map->lCount++];
+    undo->sym = sym;
+    undo->prev = map->bindings[sym];
+
+    map->bindings[sym].scope = scope;
+    map->bindings[sym].index = index;
+}
@@ -0,0 +1,67 @@
+#ifndef UTABLE_H
+#define UTABLE_H
+
+#include "uxncle.h"
+
+/* ==================================[[ identifier interning ]]================================== */
+
+typedef struct {
+    char *str; /* points into the source, not owned by the table */
+    int len;
+    uint32_t hash;
+} USymbol;
+
+typedef struct {
+    USymbol *syms; /* indexed by symbol id */
+    int sCount;
+    int sCap;
+    int *slots; /* open addressed hash table, holds symbol id + 1 (0 is an empty slot) */
+    int slotCap; /* always a power of 2 */
+} UInternTable;
+
+void UT_initInternTable(UInternTable *tbl);
+void UT_freeInternTable(UInternTable *tbl);
+
+/* returns the symbol id for the identifier, the same text always returns the same id */
+int UT_intern(UInternTable *tbl, char *str, int len);
+
+/* returns the symbol id for the identifier, or -1 if it was never interned */
+int UT_find(UInternTable *tbl, const char *str, int len);
+
+/* ==================================[[ scoped symbol map ]]================================== */
+
+typedef struct {
+    int scope; /* -1 if the symbol isn't bound */
+    int index;
+} UBinding;
+
+typedef struct {
+    int sym;
+    UBinding prev; /* binding to restore when the scope is popped */
+} UBindingUndo;
+
+typedef struct {
+    UBinding *bindings; /* indexed by symbol id */
+    int bCap;
+    UBindingUndo *log;
+    int lCount;
+    int lCap;
+    int *marks; /* log position at the start of each scope */
+    int mCount;
+    int mCap;
+} UScopeMap;
+
+void UT_initScopeMap(UScopeMap *map);
+void UT_freeScopeMap(UScopeMap *map);
+
+void UT_pushScope(UScopeMap *map);
+
+/* unbinds every symbol bound since the matching UT_pushScope */
+void UT_popScope(UScopeMap *map);
+
+/* returns NULL if the symbol isn't bound */
+UBinding *UT_lookup(UScopeMap *map, int sym);
+
+void UT_bind(UScopeMap *map, int sym, int scope, int index);
+
+#endif
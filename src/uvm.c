@@ -0,0 +1,261 @@
+#include "uvm.h"
+#include "uir.h"
+
+typedef struct {
+    UVM *vm;
+    UStack *src; /* stack the instruction reads from */
+    UStack *dst; /* the other stack */
+    int *sp; /* pointer operands are popped with, this is a copy for keep mode */
+    int isShort;
+    int fault;
+} UStep;
+
+/* ==================================[[ stack helpers ]]================================== */
+
+int fault(UStep *step, const char *msg) {
+    if (!step->fault)
+        sprintf(step->vm->err, "%s", msg);
+    step->fault = 1;
+    return 0;
+}
+
+int pop8(UStep *step) {
+    if (*step->sp <= 0)
+        return fault(step, "Stack underflow!");
+
+    return step->src->dat[--*step->sp];
+}
+
+int pop16(UStep *step) {
+    int lo = pop8(step);
+    return (pop8(step) << 8) | lo;
+}
+
+int popVal(UStep *step) {
+    return step->isShort ? pop16(step) : pop8(step);
+}
+
+void push8To(UStep *step, UStack *stack, int val) {
+    if (stack->ptr >= STACK_SIZE) {
+        fault(step, "Stack overflow!");
+        return;
+    }
+
+    stack->dat[stack->ptr++] = (uint8_t)val;
+}
+
+void push16To(UStep *step, UStack *stack, int val) {
+    push8To(step, stack, val >> 8);
+    push8To(step, stack, val);
+}
+
+void pushVal(UStep *step, int val) {
+    if (step->isShort)
+        push16To(step, step->src, val);
+    else
+        push8To(step, step->src, val);
+}
+
+/* ==================================[[ memory helpers ]]================================== */
+
+int peekMem(UStep *step, uint16_t addr, int zeroPage) {
+    uint8_t *ram = step->vm->ram;
+
+    if (!step->isShort)
+        return ram[addr];
+
+    /* zero-page shorts wrap around the zero-page */
+    return (ram[addr] << 8) | ram[zeroPage ? (uint8_t)(addr + 1) : (uint16_t)(addr + 1)];
+}
+
+void pokeMem(UStep *step, uint16_t addr, int val, int zeroPage) {
+    UVM *vm = step->vm;
+
+    if (!step->isShort) {
+        vm->ram[addr] = (uint8_t)val;
+        return;
+    }
+
+    vm->ram[addr] = (uint8_t)(val >> 8);
+    vm->ram[zeroPage ? (uint8_t)(addr + 1) : (uint16_t)(addr + 1)] = (uint8_t)val;
+
+    /* track the heap pointer */
+    if (zeroPage && addr == vm->heapAddr) {
+        if (vm->heapBase == -1)
+            vm->heapBase = val;
+        if (val > vm->heapPeak)
+            vm->heapPeak = val;
+    }
+}
+
+void deviceOut(UStep *step, uint8_t port, int val) {
+    UVM *vm = step->vm;
+
+    vm->dev[port] = (uint8_t)val;
+    if (port == PORT_CONSOLE_CHAR && vm->console)
+        fputc(val, vm->console);
+}
+
+/* ==================================[[ cpu ]]================================== */
+
+void UV_initVM(UVM *vm, URom *rom, FILE *console) {
+    memcpy(vm->ram, rom->data, ROM_MEMORY);
+    memset(vm->ram, 0, ROM_START); /* zero-page starts empty */
+    memset(vm->dev, 0, sizeof(vm->dev));
+    memset(vm->opcodes, 0, sizeof(vm->opcodes));
+    vm->wst.ptr = 0;
+    vm->rst.ptr = 0;
+    vm->console = console;
+    vm->limit = 0;
+    vm->instructions = 0;
+    vm->peakWst = 0;
+    vm->peakRst = 0;
+    vm->heapAddr = UR_findLabel(rom, "uxncle/heap");
+    vm->heapBase = -1;
+    vm->heapPeak = 0;
+    vm->err[0] = '\0';
+}
+
+int UV_run(UVM *vm, uint16_t pc) {
+    UStep step;
+    uint8_t instr;
+    int a, b, c, kptr;
+
+    step.vm = vm;
+    step.fault = 0;
+
+    while ((instr = vm->ram[pc]) != 0x00) { /* BRK */
+        pc++;
+        vm->instructions++;
+        vm->opcodes[instr]++;
+
+        if (vm->limit && vm->instructions > vm->limit)
+            return fault(&step, "Instruction limit reached!");
+
+        /* decode the modes */
+        step.isShort = instr & 0x20;
+        step.src = (instr & 0x40) ? &vm->rst : &vm->wst;
+        step.dst = (instr & 0x40) ? &vm->wst : &vm->rst;
+        kptr = step.src->ptr;
+        step.sp = (instr & 0x80) ? &kptr : &step.src->ptr;
+
+        switch (instr & 0x1f) {
+            case 0x00: /* LIT */
+                if (step.isShort) {
+                    push16To(&step, step.src, (vm->ram[pc] << 8) | vm->ram[(uint16_t)(pc + 1)]);
+                    pc += 2;
+                } else {
+                    push8To(&step, step.src, vm->ram[pc++]);
+                }
+                break;
+            case 0x01: a = popVal(&step); pushVal(&step, a + 1); break; /* INC */
+            case 0x02: popVal(&step); break; /* POP */
+            case 0x03: b = popVal(&step); popVal(&step); pushVal(&step, b); break; /* NIP */
+            case 0x04: b = popVal(&step); a = popVal(&step); pushVal(&step, b); pushVal(&step, a); break; /* SWP */
+            case 0x05: /* ROT */
+                c = popVal(&step); b = popVal(&step); a = popVal(&step);
+                pushVal(&step, b); pushVal(&step, c); pushVal(&step, a);
+                break;
+            case 0x06: a = popVal(&step); pushVal(&step, a); pushVal(&step, a); break; /* DUP */
+            case 0x07: b = popVal(&step); a = popVal(&step); pushVal(&step, a); pushVal(&step, b); pushVal(&step, a); break; /* OVR */
+            case 0x08: b = popVal(&step); a = popVal(&step); push8To(&step, step.src, a == b); break; /* EQU */
+            case 0x09: b = popVal(&step); a = popVal(&step); push8To(&step, step.src, a != b); break; /* NEQ */
+            case 0x0a: b = popVal(&step); a = popVal(&step); push8To(&step, step.src, a > b); break; /* GTH */
+            case 0x0b: b = popVal(&step); a = popVal(&step); push8To(&step, step.src, a < b); break; /* LTH */
+            case 0x0c: /* JMP */
+                a = popVal(&step);
+                pc = step.isShort ? a : pc + (int8_t)a;
+                break;
+            case 0x0d: /* JCN */
+                a = popVal(&step);
+                if (pop8(&step))
+                    pc = step.isShort ? a : pc + (int8_t)a;
+                break;
+            case 0x0e: /* JSR */
+                a = popVal(&step);
+                push16To(&step, step.dst, pc);
+                pc = step.isShort ? a : pc + (int8_t)a;
+                break;
+            case 0x0f: /* STH */
+                a = popVal(&step);
+                if (step.isShort)
+                    push16To(&step, step.dst, a);
+                else
+                    push8To(&step, step.dst, a);
+                break;
+            case 0x10: a = pop8(&step); pushVal(&step, peekMem(&step, a, 1)); break; /* LDZ */
+            case 0x11: a = pop8(&step); b = popVal(&step); pokeMem(&step, a, b, 1); break; /* STZ */
+            case 0x12: a = pop8(&step); pushVal(&step, peekMem(&step, pc + (int8_t)a, 0)); break; /* LDR */
+            case 0x13: a = pop8(&step); b = popVal(&step); pokeMem(&step, pc + (int8_t)a, b, 0); break; /* STR */
+            case 0x14: a = pop16(&step); pushVal(&step, peekMem(&step, a, 0)); break; /* LDA */
+            case 0x15: a = pop16(&step); b = popVal(&step); pokeMem(&step, a, b, 0); break; /* STA */
+            case 0x16: /* DEI */
+                a = pop8(&step);
+                pushVal(&step, step.isShort ? (vm->dev[a] << 8) | vm->dev[(uint8_t)(a + 1)] : vm->dev[a]);
+                break;
+            case 0x17: /* DEO */
+                a = pop8(&step);
+                b = popVal(&step);
+                if (step.isShort) {
+                    deviceOut(&step, a, b >> 8);
+                    deviceOut(&step, (uint8_t)(a + 1), b);
+                } else {
+                    deviceOut(&step, a, b);
+                }
+                break;
+            case 0x18: b = popVal(&step); a = popVal(&step); pushVal(&step, a + b); break; /* ADD */
+            case 0x19: b = popVal(&step); a = popVal(&step); pushVal(&step, a - b); break; /* SUB */
+            case 0x1a: b = popVal(&step); a = popVal(&step); pushVal(&step, a * b); break; /* MUL */
+            case 0x1b: b = popVal(&step); a = popVal(&step); pushVal(&step, b ? a / b : 0); break; /* DIV */
+            case 0x1c: b = popVal(&step); a = popVal(&step); pushVal(&step, a & b); break; /* AND */
+            case 0x1d: b = popVal(&step); a = popVal(&step); pushVal(&step, a | b); break; /* ORA */
+            case 0x1e: b = popVal(&step); a = popVal(&step); pushVal(&step, a ^ b); break; /* EOR */
+            case 0x1f: a = pop8(&step); b = popVal(&step); pushVal(&step, (b >> (a & 0x0f)) << (a >> 4)); break; /* SFT */
+        }
+
+        if (step.fault)
+            return 0;
+
+        /* track the stack depths */
+        if (vm->wst.ptr > vm->peakWst)
+            vm->peakWst = vm->wst.ptr;
+        if (vm->rst.ptr > vm->peakRst)
+            vm->peakRst = vm->rst.ptr;
+
+        /* the program asked to halt */
+        if (vm->dev[PORT_SYSTEM_STATE])
+            break;
+    }
+
+    return 1;
+}
+
+/* ==================================[[ stats ]]================================== */
+
+void UV_printStats(UVM *vm, FILE *out) {
+    int order[0x100];
+    char name[8];
+    int i, j, op;
+
+    fprintf(out, "instructions: %lu\n", vm->instructions);
+    fprintf(out, "peak wst: %d bytes\n", vm->peakWst);
+    fprintf(out, "peak rst: %d bytes\n", vm->peakRst);
+    if (vm->heapBase != -1)
+        fprintf(out, "heap: %d bytes\n", vm->heapPeak - vm->heapBase);
+    else
+        fprintf(out, "heap: unused\n");
+
+    /* insertion sort, most used first */
+    for (i = 0; i < 0x100; i++) {
+        op = i;
+        for (j = i; j > 0 && vm->opcodes[order[j - 1]] < vm->opcodes[op]; j--)
+            order[j] = order[j - 1];
+        order[j] = op;
+    }
+
+    fprintf(out, "opcodes:\n");
+    for (i = 0; i < 0x100 && vm->opcodes[order[i]] > 0; i++) {
+        fprintf(out, "\t%-7s %10lu %5.1f%%\n", UI_opcodeName(order[i], name), vm->opcodes[order[i]],
+            100.0 * vm->opcodes[order[i]] / vm->instructions);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef UVM_H
+#define UVM_H
+
+#include "uxncle.h"
+#include "urom.h"
+
+#define STACK_SIZE 0x100
+
+/* device ports used by the generated code */
+#define PORT_SYSTEM_STATE 0x0f
+#define PORT_CONSOLE_CHAR 0x18
+
+typedef struct {
+    uint8_t dat[STACK_SIZE];
+    int ptr;
+} UStack;
+
+typedef struct {
+    uint8_t ram[ROM_MEMORY];
+    uint8_t dev[0x100];
+    UStack wst; /* working stack */
+    UStack rst; /* return stack */
+    FILE *console; /* Console/char writes go here, can be NULL */
+    unsigned long limit; /* faults after this many instructions, 0 for no limit */
+    /* counters */
+    unsigned long instructions; /* instructions retired */
+    unsigned long opcodes[0x100]; /* instructions retired per encoded opcode */
+    int peakWst;
+    int peakRst;
+    int heapAddr; /* zero-page address of .uxncle/heap, -1 if it isn't tracked */
+    int heapBase; /* first value stored to the heap pointer, -1 if it was never set */
+    int heapPeak; /* highest value stored to the heap pointer */
+    char err[128];
+} UVM;
+
+/* loads the assembled rom, console output is written to the provided file stream */
+void UV_initVM(UVM *vm, URom *rom, FILE *console);
+
+/* runs until BRK, returns 0 and sets vm->err if the program faulted */
+int UV_run(UVM *vm, uint16_t pc);
+
+/* writes the counters & the opcode histogram, most used first */
+void UV_printStats(UVM *vm, FILE *out);
+
+#endif
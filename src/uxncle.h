@@ -9,4 +9,17 @@
 
 #include <string.h>
 
+/* part of the compile cache key (see ucache.h), bump it whenever the generated code changes */
+#define UXNCLE_VERSION "0.6.2"
+
+/* optimizations, see main.c for the matching command line switches */
+typedef struct {
+    int foldConstants; /* fold constant expressions at compile time */
+    int zeroPage; /* promote the hottest locals into the zero-page */
+    int peephole; /* rewrite redundant instruction sequences */
+    int strengthReduce; /* turn multiplies & divides by constants into shifts & adds */
+    int deadCode; /* remove unreachable code, dead stores & vars that are never used */
+    int staticFrame; /* give every var a fixed address instead of allocating scopes on the heap (there's no recursion yet) */
+} UOptions;
+
 #endif
\ No newline at end of file